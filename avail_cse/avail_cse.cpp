@@ -0,0 +1,253 @@
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/ValueHandle.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/SSAUpdater.h"
+
+#include "data_flow.h"
+
+using namespace llvm;
+using namespace std;
+
+/*
+ * avail_cse is global common subexpression elimination by available
+ * expressions (Muchnick, pp. 382-396), a companion pass to copy_prop built
+ * on the same data-flow solver.
+ *
+ * The pure expressions of a function (binary operators, compares and GEPs)
+ * are numbered, so that instructions identical in opcode, flags and operands
+ * share a number. In SSA form an operand is never redefined once an
+ * expression using it has been evaluated, so no block kills an expression:
+ * the COPY set of a block holds the expressions it evaluates, KILL is empty,
+ * and solveForward gives in CPIn the expressions evaluated on every path to
+ * the block. An expression a block evaluates again after an earlier
+ * evaluation in the block, or that is in its CPIn, is replaced by the value
+ * already computed. Where that value comes from different evaluations on
+ * different paths, SSAUpdater joins them with phis.
+ */
+namespace {
+
+/*
+ * isExpression returns true if ins computes a pure expression the pass
+ * numbers.
+ */
+static bool isExpression(Instruction &ins) {
+  return isa<BinaryOperator>(ins) || isa<CmpInst>(ins) ||
+         isa<GetElementPtrInst>(ins);
+}
+
+/*
+ * hashExpression hashes the opcode, type and operands of ins, so that
+ * instructions isIdenticalTo each other hash the same.
+ */
+static hash_code hashExpression(Instruction &ins) {
+  return hash_combine(ins.getOpcode(), ins.getType(),
+                      hash_combine_range(ins.value_op_begin(),
+                                         ins.value_op_end()));
+}
+
+/*
+ * AvailableExpressions holds the state of the pass for one function. Blocks
+ * are numbered by their position in reverse post order; unreachable blocks
+ * are left alone.
+ */
+class AvailableExpressions {
+ public:
+  explicit AvailableExpressions(Function &F) : cfg(F) {}
+  /* run eliminates the redundant expressions and returns how many */
+  unsigned int run();
+
+ private:
+  cpass::CFGNumbering cfg;
+  // the evaluations of every numbered expression that remain after local
+  // elimination, at most one per block, as (block, instruction)
+  std::vector<std::vector<std::pair<uint32_t, Instruction *>>> evals;
+
+  unsigned int eliminateLocal();
+  unsigned int eliminateGlobal();
+};
+
+/*
+ * eliminateLocal numbers the expressions evaluated in more than one place,
+ * replaces every evaluation after the first in its block by the first, and
+ * records the first ones in evals. Returns the number of instructions
+ * removed.
+ */
+unsigned int AvailableExpressions::eliminateLocal() {
+  // the first instruction seen for every expression, by hash
+  DenseMap<hash_code, SmallVector<Instruction *, 1>> seen;
+  DenseMap<Instruction *, uint32_t> expr_of;
+  std::vector<uint32_t> uses;
+  std::vector<std::pair<uint32_t, Instruction *>> found;
+
+  for (uint32_t b = 0; b < cfg.rpo.size(); b++) {
+    for (Instruction &ins : *cfg.rpo[b]) {
+      if (!isExpression(ins)) continue;
+      SmallVector<Instruction *, 1> &same = seen[hashExpression(ins)];
+      uint32_t e = uses.size();
+      for (Instruction *first : same) {
+        if (ins.isIdenticalTo(first)) {
+          e = expr_of[first];
+          break;
+        }
+      }
+      if (e == uses.size()) {
+        same.push_back(&ins);
+        uses.push_back(0);
+      }
+      uses[e]++;
+      found.push_back({b, &ins});
+      expr_of[&ins] = e;
+    }
+  }
+
+  // number the expressions that can be redundant, and keep the first
+  // evaluation of each in each block
+  std::vector<uint32_t> number(uses.size(), UINT32_MAX);
+  std::vector<uint32_t> last_block;
+  std::vector<Instruction *> removed;
+  for (auto &f : found) {
+    uint32_t e = expr_of[f.second];
+    if (uses[e] < 2) continue;
+    if (number[e] == UINT32_MAX) {
+      number[e] = evals.size();
+      evals.emplace_back();
+      last_block.push_back(UINT32_MAX);
+    }
+    uint32_t n = number[e];
+    if (last_block[n] == f.first) {
+      f.second->replaceAllUsesWith(evals[n].back().second);
+      removed.push_back(f.second);
+    } else {
+      evals[n].push_back(f);
+      last_block[n] = f.first;
+    }
+  }
+  for (Instruction *ins : removed) {
+    ins->eraseFromParent();
+  }
+  return removed.size();
+}
+
+/*
+ * eliminateGlobal solves the available expressions and replaces every
+ * evaluation of an expression available on entry to its block by the value
+ * available there. Returns the number of instructions removed.
+ */
+unsigned int AvailableExpressions::eliminateGlobal() {
+  BumpPtrAllocator arena;
+  auto *blocks = arena.Allocate<cpass::BasicBlockInfo<cpass::BitSet>>(
+      cfg.rpo.size());
+  for (uint32_t b = 0; b < cfg.rpo.size(); b++) {
+    new (&blocks[b]) cpass::BasicBlockInfo<cpass::BitSet>(arena, evals.size());
+  }
+  for (uint32_t e = 0; e < evals.size(); e++) {
+    for (auto &eval : evals[e]) {
+      blocks[eval.first].COPY.set(e);
+    }
+  }
+  cpass::solveForward(blocks, cfg.pred_begin.data(), cfg.preds.data(),
+                      cfg.rpo.size());
+
+  // every replacement is found before any instruction is replaced, since
+  // SSAUpdater looks up the evaluations in the other blocks. A replacement
+  // may itself be replaced, which its handle follows
+  std::vector<std::pair<Instruction *, WeakTrackingVH>> replaced;
+  SmallVector<PHINode *, 8> phis;
+  for (uint32_t e = 0; e < evals.size(); e++) {
+    size_t first = replaced.size();
+    for (auto &eval : evals[e]) {
+      if (blocks[eval.first].CPIn.test(e)) {
+        replaced.push_back({eval.second, WeakTrackingVH()});
+      }
+    }
+    if (replaced.size() == first) continue;
+
+    Instruction *any = evals[e][0].second;
+    SSAUpdater ssa(&phis);
+    ssa.Initialize(any->getType(), any->getName());
+    for (auto &eval : evals[e]) {
+      ssa.AddAvailableValue(cfg.rpo[eval.first], eval.second);
+    }
+    for (size_t r = first; r < replaced.size(); r++) {
+      replaced[r].second =
+          ssa.GetValueInMiddleOfBlock(replaced[r].first->getParent());
+    }
+  }
+
+  for (auto &r : replaced) {
+    r.first->replaceAllUsesWith(r.second);
+  }
+  for (auto &r : replaced) {
+    r.first->eraseFromParent();
+  }
+
+  // a phi joining an evaluation that has been replaced by the phi itself,
+  // around a loop, only has one other value
+  DenseSet<PHINode *> erased;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (PHINode *phi : phis) {
+      if (erased.count(phi)) continue;
+      if (Value *v = phi->hasConstantValue()) {
+        phi->replaceAllUsesWith(v);
+        phi->eraseFromParent();
+        erased.insert(phi);
+        changed = true;
+      }
+    }
+  }
+  return replaced.size();
+}
+
+unsigned int AvailableExpressions::run() {
+  unsigned int removed = eliminateLocal();
+  if (!evals.empty()) {
+    removed += eliminateGlobal();
+  }
+  return removed;
+}
+
+class AvailableExpressionsCSE : public FunctionPass {
+ public:
+  static char ID;
+  static cl::opt<bool> cse_stats;
+  unsigned int removed = 0;
+  AvailableExpressionsCSE() : FunctionPass(ID) {}
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.setPreservesCFG();
+  }
+
+  bool runOnFunction(Function &F) override {
+    unsigned int n = AvailableExpressions(F).run();
+    removed += n;
+    return n > 0;
+  }
+
+  bool doFinalization(Module &M) override {
+    if (cse_stats) {
+      errs() << "avail_cse: " << removed << " expressions removed\n";
+    }
+    removed = 0;
+    return false;
+  }
+};  // end AvailableExpressionsCSE
+}  // end anonymous namespace
+
+char AvailableExpressionsCSE::ID = 0;
+static RegisterPass<AvailableExpressionsCSE> X(
+    "avail_cse", "available expressions CSE", false /* Only looks at CFG */,
+    false /* Analysis Pass */);
+
+cl::opt<bool> AvailableExpressionsCSE::cse_stats(
+    "cse-stats", cl::desc("print the number of expressions removed"),
+    cl::init(false));
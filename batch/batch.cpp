@@ -0,0 +1,170 @@
+/*
+ * cpass-batch: runs copy_prop over every function of a module and writes the
+ * result as textual IR, without holding the whole module in memory.
+ *
+ * Bitcode input is memory mapped and loaded lazily. Each function body is
+ * materialized just before it is printed, run through the pass, printed and
+ * then deleted, so peak memory grows with the largest function rather than
+ * with the module. Textual input has to be parsed up front, but bodies are
+ * still released as they are written. Pipe the output through llvm-as for
+ * bitcode.
+ *
+ * With -split=N the module is loaded whole instead, split into N partitions
+ * that are processed on -workers threads, and relinked; see split.h. This
+ * suits a single huge post-link LTO module when cores are more plentiful
+ * than memory.
+ *
+ * usage: cpass-batch [-local] [-verbose] [-cache-dir=dir]
+ *                    [-split=N [-workers=N]] [-o output] input
+ */
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/IR/AssemblyAnnotationWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "cpass.h"
+#include "result_cache.h"
+#include "split.h"
+
+using namespace llvm;
+using namespace std;
+
+static cl::opt<string> input_file(cl::Positional, cl::desc("<input file>"),
+                                  cl::init("-"));
+static cl::opt<string> output_file("o", cl::desc("output file"),
+                                   cl::value_desc("filename"), cl::init("-"));
+static cl::opt<bool> local_only("local",
+                                cl::desc("run local copy propagation only"),
+                                cl::init(false));
+static cl::opt<bool> verbose("verbose", cl::desc("turn on verbose printing"),
+                             cl::init(false));
+static cl::opt<string> cache_dir("cache-dir",
+                                 cl::desc("reuse results cached in this "
+                                          "directory"),
+                                 cl::init(""));
+static cl::opt<unsigned> cache_size(
+    "cache-size", cl::desc("size limit of the result cache in MiB"),
+    cl::init(256));
+static cl::opt<unsigned> nr_partitions(
+    "split", cl::desc("split the module into this many partitions and "
+                      "process them in parallel (0 = stream instead)"),
+    cl::init(0));
+static cl::opt<unsigned> nr_threads(
+    "workers", cl::desc("threads used with -split (default: all cores)"),
+    cl::init(0));
+
+static ExitOnError exit_on_err;
+
+/*
+ * StreamingPropagation hooks into the module printer. The printer calls
+ * emitFunctionAnnot just before it prints each function, which is where the
+ * body is loaded and optimized; the previous function has been printed by
+ * then, so its body is released.
+ */
+class StreamingPropagation : public AssemblyAnnotationWriter {
+ private:
+  cpass::Options opts;
+  Function *prev = nullptr;
+
+  void release() {
+    if (!prev || prev->isDeclaration()) return;
+    // blockaddress constants elsewhere still refer to its blocks
+    for (BasicBlock &bb : *prev) {
+      if (bb.hasAddressTaken()) return;
+    }
+    prev->deleteBody();
+  }
+
+ public:
+  StreamingPropagation(const cpass::Options &opts) : opts(opts) {}
+  ~StreamingPropagation() { release(); }
+
+  void emitFunctionAnnot(const Function *F,
+                         formatted_raw_ostream &os) override {
+    release();
+    // the printer only passes a const pointer to the function it prints
+    prev = const_cast<Function *>(F);
+    exit_on_err(prev->materialize());
+    if (!prev->isDeclaration()) {
+      cpass::propagate(*prev, opts);
+    }
+  }
+};
+
+/*
+ * loadModule reads input_file lazily if it is bitcode. The buffer is mapped
+ * rather than read when it is large enough, and must outlive the module.
+ */
+static std::unique_ptr<Module> loadModule(LLVMContext &ctx) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buf = MemoryBuffer::getFileOrSTDIN(
+      input_file, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+  if (!buf) {
+    errs() << "cpass-batch: cannot read " << input_file << ": "
+           << buf.getError().message() << "\n";
+    exit(1);
+  }
+
+  SMDiagnostic err;
+  std::unique_ptr<Module> m = getLazyIRModule(std::move(*buf), err, ctx);
+  if (!m) {
+    err.print("cpass-batch", errs());
+    exit(1);
+  }
+  return m;
+}
+
+int main(int argc, char **argv) {
+  InitLLVM init(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv, "copy_prop batch driver\n");
+  exit_on_err.setBanner("cpass-batch: ");
+
+  LLVMContext ctx;
+  std::unique_ptr<Module> m = loadModule(ctx);
+
+  std::error_code ec;
+  ToolOutputFile out(output_file, ec, sys::fs::OF_Text);
+  if (ec) {
+    errs() << "cpass-batch: cannot write " << output_file << ": "
+           << ec.message() << "\n";
+    return 1;
+  }
+
+  std::unique_ptr<cpass::ResultCache> cache;
+  if (!cache_dir.empty()) {
+    cache.reset(new cpass::ResultCache(cache_dir, (uint64_t)cache_size << 20));
+  }
+
+  cpass::Options opts;
+  opts.global = !local_only;
+  opts.verbose = verbose;
+  opts.cache = cache.get();
+  if (nr_partitions) {
+    // hardware_concurrency returns 0 when it cannot tell
+    unsigned threads =
+        nr_threads ? nr_threads : max(1u, thread::hardware_concurrency());
+    exit_on_err(m->materializeAll());
+    m = exit_on_err(
+        cpass::propagateSplit(std::move(m), opts, nr_partitions, threads));
+    m->print(out.os(), nullptr);
+  } else {
+    StreamingPropagation streamer(opts);
+    m->print(out.os(), &streamer);
+  }
+  out.keep();
+  return 0;
+}
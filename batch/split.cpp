@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#include "cpass.h"
+#include "split.h"
+
+using namespace llvm;
+using namespace std;
+
+namespace cpass {
+
+/*
+ * Partition is one part of a split module, as bitcode, before and after
+ * the pass has run over it.
+ */
+struct Partition {
+  SmallVector<char, 0> bitcode;
+  string log;
+  string error;
+};
+
+/*
+ * runPartition parses p into a context of its own, runs the pass over every
+ * function it defines and replaces p's bitcode with the result.
+ */
+static void runPartition(Partition &p, const Options &opts) {
+  LLVMContext ctx;
+  Expected<std::unique_ptr<Module>> m = parseBitcodeFile(
+      MemoryBufferRef(StringRef(p.bitcode.data(), p.bitcode.size()),
+                      "<partition>"),
+      ctx);
+  if (!m) {
+    p.error = toString(m.takeError());
+    return;
+  }
+
+  raw_string_ostream log_os(p.log);
+  Options part_opts = opts;
+  part_opts.log = &log_os;
+  for (Function &f : **m) {
+    if (!f.isDeclaration()) {
+      propagate(f, part_opts);
+    }
+  }
+  log_os.flush();
+
+  p.bitcode.clear();
+  raw_svector_ostream os(p.bitcode);
+  WriteBitcodeToFile(**m, os);
+}
+
+/*
+ * matchDistinct maps the distinct nodes reachable from dup to the ones at
+ * the same place under canon. Every partition is a clone of one module, so
+ * their metadata graphs have the same shape.
+ */
+static void matchDistinct(const MDNode *dup, const MDNode *canon,
+                          ValueToValueMapTy &vm,
+                          SmallPtrSetImpl<const MDNode *> &seen) {
+  if (dup == canon || !seen.insert(dup).second ||
+      dup->getMetadataID() != canon->getMetadataID() ||
+      dup->isDistinct() != canon->isDistinct() ||
+      dup->getNumOperands() != canon->getNumOperands()) {
+    return;
+  }
+  if (dup->isDistinct()) {
+    vm.MD()[dup].reset(const_cast<MDNode *>(canon));
+  }
+  for (unsigned i = 0; i < dup->getNumOperands(); i++) {
+    const auto *d = dyn_cast_or_null<MDNode>(dup->getOperand(i));
+    const auto *c = dyn_cast_or_null<MDNode>(canon->getOperand(i));
+    if (d && c) matchDistinct(d, c, vm, seen);
+  }
+}
+
+/*
+ * dedupNamedMetadata removes the copies of named metadata operands that
+ * every partition brought along. counts holds each node's operand count in
+ * the source module: operand i of a later partition is a copy of operand
+ * i % count of the first. Distinct nodes, like compile units, are copied
+ * rather than shared, so everything that refers to a copy is remapped to
+ * the first partition's node. Module flags are merged by the linker.
+ */
+static void dedupNamedMetadata(Module &m, const map<string, unsigned> &counts) {
+  ValueToValueMapTy vm;
+  SmallPtrSet<const MDNode *, 32> seen;
+  for (NamedMDNode &nmd : m.named_metadata()) {
+    auto count = counts.find(nmd.getName().str());
+    if (nmd.getName() == "llvm.module.flags" || count == counts.end() ||
+        count->second == 0) {
+      continue;
+    }
+    for (unsigned i = count->second; i < nmd.getNumOperands(); i++) {
+      matchDistinct(nmd.getOperand(i), nmd.getOperand(i % count->second), vm,
+                    seen);
+    }
+  }
+
+  ValueMapper mapper(vm, RF_ReuseAndMutateDistinctMDs | RF_IgnoreMissingLocals);
+  if (!vm.MD().empty()) {
+    for (Function &f : m) {
+      mapper.remapFunction(f);
+    }
+    for (GlobalVariable &gv : m.globals()) {
+      SmallVector<pair<unsigned, MDNode *>, 1> mds;
+      gv.getAllMetadata(mds);
+      gv.clearMetadata();
+      for (auto &md : mds) {
+        gv.addMetadata(md.first, *mapper.mapMDNode(*md.second));
+      }
+    }
+  }
+
+  for (NamedMDNode &nmd : m.named_metadata()) {
+    if (nmd.getName() == "llvm.module.flags") continue;
+    vector<MDNode *> ops;
+    set<MDNode *> unique;
+    for (MDNode *op : nmd.operands()) {
+      if (!vm.MD().empty()) op = mapper.mapMDNode(*op);
+      if (unique.insert(op).second) ops.push_back(op);
+    }
+    nmd.clearOperands();
+    for (MDNode *op : ops) {
+      nmd.addOperand(op);
+    }
+  }
+}
+
+Expected<std::unique_ptr<Module>> propagateSplit(std::unique_ptr<Module> m,
+                                                 const Options &opts,
+                                                 unsigned partitions,
+                                                 unsigned threads) {
+  // SplitModule externalizes local symbols; remember them to restore later
+  map<GlobalValue *, pair<GlobalValue::LinkageTypes,
+                          GlobalValue::VisibilityTypes>> locals;
+  for (GlobalValue &gv : m->global_values()) {
+    if (gv.hasLocalLinkage()) {
+      locals[&gv] = {gv.getLinkage(), gv.getVisibility()};
+    }
+  }
+
+  vector<Partition> parts;
+  SplitModule(*m, partitions ? partitions : 1,
+              [&](std::unique_ptr<Module> part) {
+                parts.emplace_back();
+                raw_svector_ostream os(parts.back().bitcode);
+                WriteBitcodeToFile(*part, os);
+              });
+
+  // symbols now all have names, which is how the linked result refers to them
+  map<string, pair<GlobalValue::LinkageTypes, GlobalValue::VisibilityTypes>>
+      restore;
+  for (auto &l : locals) {
+    restore[l.first->getName().str()] = l.second;
+  }
+  vector<string> fn_order, var_order;
+  for (Function &f : *m) {
+    fn_order.push_back(f.getName().str());
+  }
+  for (GlobalVariable &gv : m->globals()) {
+    var_order.push_back(gv.getName().str());
+  }
+  map<string, unsigned> md_counts;
+  for (NamedMDNode &nmd : m->named_metadata()) {
+    md_counts[nmd.getName().str()] = nmd.getNumOperands();
+  }
+
+  atomic<unsigned> next(0);
+  vector<thread> workers;
+  // at least one worker, or the partitions would be left unoptimized
+  for (unsigned t = 0; t < max(threads, 1u) && t < parts.size(); t++) {
+    workers.emplace_back([&]() {
+      for (unsigned i = next++; i < parts.size(); i = next++) {
+        runPartition(parts[i], opts);
+      }
+    });
+  }
+  for (thread &w : workers) {
+    w.join();
+  }
+
+  // the first partition becomes the result and the others are linked into it
+  LLVMContext &ctx = m->getContext();
+  string id = m->getModuleIdentifier(), source = m->getSourceFileName();
+  // every partition carries the module's inline asm
+  string inline_asm = m->getModuleInlineAsm();
+  m.reset();
+
+  std::unique_ptr<Module> linked;
+  for (Partition &p : parts) {
+    if (!p.error.empty()) {
+      return createStringError(inconvertibleErrorCode(), p.error);
+    }
+    if (opts.verbose) {
+      (opts.log ? *opts.log : errs()) << p.log;
+    }
+    Expected<std::unique_ptr<Module>> part = parseBitcodeFile(
+        MemoryBufferRef(StringRef(p.bitcode.data(), p.bitcode.size()),
+                        "<partition>"),
+        ctx);
+    if (!part) {
+      return part.takeError();
+    }
+    p.bitcode.clear();
+    if (!linked) {
+      linked = std::move(*part);
+    } else if (Linker::linkModules(*linked, std::move(*part))) {
+      return createStringError(inconvertibleErrorCode(),
+                               "cannot link partitions");
+    }
+  }
+  linked->setModuleIdentifier(id);
+  linked->setSourceFileName(source);
+  linked->setModuleInlineAsm(inline_asm);
+  dedupNamedMetadata(*linked, md_counts);
+
+  for (auto &r : restore) {
+    GlobalValue *gv = linked->getNamedValue(r.first);
+    if (gv) {
+      gv->setVisibility(r.second.second);
+      gv->setLinkage(r.second.first);
+    }
+  }
+
+  // put definitions back in their original order
+  for (const string &name : fn_order) {
+    Function *f = linked->getFunction(name);
+    if (f) {
+      linked->getFunctionList().splice(linked->end(),
+                                       linked->getFunctionList(), f);
+    }
+  }
+  for (const string &name : var_order) {
+    GlobalVariable *gv = linked->getGlobalVariable(name, true);
+    if (gv) {
+      linked->getGlobalList().splice(linked->global_end(),
+                                     linked->getGlobalList(), gv);
+    }
+  }
+  return std::move(linked);
+}
+
+}  // namespace cpass
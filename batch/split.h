@@ -0,0 +1,32 @@
+#ifndef CPASS_SPLIT_H
+#define CPASS_SPLIT_H
+
+#include <memory>
+
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+
+#include "cpass.h"
+
+namespace cpass {
+
+/*
+ * propagateSplit runs copy propagation over a large module, such as a
+ * post-link LTO module, in parallel. m is split into partitions of whole
+ * functions; symbols referenced across partitions are made external while
+ * split, as for LTO code generation. Each partition is serialized and run
+ * on one of threads threads in its own LLVMContext, and the results are
+ * linked back into a single module in m's context.
+ *
+ * The returned module has the same symbols, linkage and function order as
+ * m, apart from unnamed globals, which are given names. Verbose output is
+ * collected per partition and written to opts.log in partition order. m is
+ * consumed.
+ */
+llvm::Expected<std::unique_ptr<llvm::Module>> propagateSplit(
+    std::unique_ptr<llvm::Module> m, const Options &opts, unsigned partitions,
+    unsigned threads);
+
+}  // namespace cpass
+
+#endif  // CPASS_SPLIT_H
@@ -0,0 +1,180 @@
+/*
+ * cpass-jit-bench: compile latency of single functions in an LLJIT, with no
+ * IR transform and with copy_prop at the local and global tiers.
+ *
+ * Every function defined in the input is split into its own module (global
+ * variables are kept, other functions become declarations) and compiled
+ * -iterations times per tier by adding it to a fresh JITDylib and looking it
+ * up. The time measured covers the IR transform, code generation and
+ * linking, but not parsing.
+ *
+ * usage: cpass-jit-bench [-iterations=N] [-per-function] input.ll
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/Mangling.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include "cpass_jit.h"
+
+using namespace llvm;
+using namespace llvm::orc;
+using namespace std;
+
+static cl::opt<string> input_file(cl::Positional, cl::desc("<input file>"),
+                                  cl::Required);
+static cl::opt<unsigned> iterations("iterations",
+                                    cl::desc("compiles per function and tier"),
+                                    cl::init(5));
+static cl::opt<bool> per_function("per-function",
+                                  cl::desc("print the median of every function"),
+                                  cl::init(false));
+
+static ExitOnError exit_on_err;
+
+struct FunctionModule {
+  string name;
+  SmallVector<char, 0> bitcode;
+  vector<string> callees;  // functions defined elsewhere in the input
+};
+
+/*
+ * splitFunctions returns one bitcode module per function defined in m.
+ */
+static vector<FunctionModule> splitFunctions(Module &m) {
+  vector<FunctionModule> result;
+
+  for (Function &f : m) {
+    if (f.isDeclaration()) {
+      continue;
+    }
+
+    ValueToValueMapTy vmap;
+    std::unique_ptr<Module> clone =
+        CloneModule(m, vmap, [&f](const GlobalValue *gv) {
+          return isa<GlobalVariable>(gv) || gv == &f;
+        });
+
+    FunctionModule fm;
+    fm.name = f.getName().str();
+    for (Function &other : m) {
+      if (&other != &f && !other.isDeclaration()) {
+        fm.callees.push_back(other.getName().str());
+      }
+    }
+    raw_svector_ostream os(fm.bitcode);
+    WriteBitcodeToFile(*clone, os);
+    result.push_back(std::move(fm));
+  }
+  return result;
+}
+
+static void unreachableCallee() {
+  report_fatal_error("benchmark code is never run");
+}
+
+/*
+ * compileOnce compiles fm in a new JITDylib of jit and returns the time
+ * taken in microseconds.
+ */
+static double compileOnce(LLJIT &jit, const FunctionModule &fm, unsigned id) {
+  auto ctx = std::make_unique<LLVMContext>();
+  MemoryBufferRef buf(StringRef(fm.bitcode.data(), fm.bitcode.size()),
+                      fm.name);
+  std::unique_ptr<Module> m = exit_on_err(parseBitcodeFile(buf, *ctx));
+
+  JITDylib &jd =
+      exit_on_err(jit.createJITDylib(fm.name + "." + to_string(id)));
+  jd.addGenerator(exit_on_err(DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      jit.getDataLayout().getGlobalPrefix())));
+
+  // other functions of the input are never called, but must resolve
+  MangleAndInterner mangle(jit.getExecutionSession(), jit.getDataLayout());
+  SymbolMap stubs;
+  for (const string &callee : fm.callees) {
+    stubs[mangle(callee)] = JITEvaluatedSymbol(
+        pointerToJITTargetAddress(&unreachableCallee), JITSymbolFlags::Exported);
+  }
+  exit_on_err(jd.define(absoluteSymbols(std::move(stubs))));
+
+  auto start = chrono::steady_clock::now();
+  exit_on_err(jit.addIRModule(jd, ThreadSafeModule(std::move(m), std::move(ctx))));
+  exit_on_err(jit.lookup(jd, fm.name));
+  auto end = chrono::steady_clock::now();
+
+  return chrono::duration<double, micro>(end - start).count();
+}
+
+static double percentile(vector<double> v, double p) {
+  std::sort(v.begin(), v.end());
+  return v[min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+int main(int argc, char **argv) {
+  InitLLVM init(argc, argv);
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+  cl::ParseCommandLineOptions(argc, argv, "copy_prop JIT latency benchmark\n");
+  exit_on_err.setBanner("cpass-jit-bench: ");
+
+  LLVMContext ctx;
+  SMDiagnostic err;
+  std::unique_ptr<Module> m = parseIRFile(input_file, err, ctx);
+  if (!m) {
+    err.print("cpass-jit-bench", errs());
+    return 1;
+  }
+  vector<FunctionModule> functions = splitFunctions(*m);
+  if (functions.empty()) {
+    errs() << "cpass-jit-bench: no functions defined in " << input_file << "\n";
+    return 1;
+  }
+
+  const char *tier_names[] = {"none", "local", "global"};
+  outs() << "tier       mean us  median us     p90 us     max us\n";
+
+  for (int tier = 0; tier < 3; tier++) {
+    cpass::CopyPropTransform transform(tier == 2 ? cpass::JITTier::Global
+                                                 : cpass::JITTier::Local);
+    std::unique_ptr<LLJIT> jit = exit_on_err(LLJITBuilder().create());
+    if (tier > 0) {
+      cpass::addCopyPropTransform(*jit, transform);
+    }
+
+    vector<double> medians;
+    for (const FunctionModule &fm : functions) {
+      vector<double> times;
+      for (unsigned i = 0; i < iterations; i++) {
+        times.push_back(compileOnce(*jit, fm, i));
+      }
+      medians.push_back(percentile(times, 0.5));
+      if (per_function) {
+        outs() << format("  %-6s %-30s %10.1f\n", tier_names[tier],
+                         fm.name.c_str(), medians.back());
+      }
+    }
+
+    double sum = 0;
+    for (double t : medians) {
+      sum += t;
+    }
+    outs() << format("%-8s %10.1f %10.1f %10.1f %10.1f\n", tier_names[tier],
+                     sum / medians.size(), percentile(medians, 0.5),
+                     percentile(medians, 0.9), percentile(medians, 1.0));
+  }
+
+  return 0;
+}
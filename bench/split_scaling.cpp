@@ -0,0 +1,172 @@
+/*
+ * cpass-split-bench: how the parallel LTO mode of cpass-batch scales with the
+ * number of cores, on a generated module with many functions.
+ *
+ * The module (100k functions by default) is in the style of clang -O0
+ * output. Functions are a mix of external and internal ones, each calling
+ * its predecessor and reading and writing shared globals, so partitions
+ * reference each other's symbols. The module is generated once and kept as
+ * bitcode; every measurement parses a fresh copy and times copy propagation
+ * only: first in place on one thread, then with propagateSplit for 1, 2,
+ * 4, ... workers up to -max-workers, with one partition per worker.
+ *
+ * Splitting and relinking serialize the module several times, so the mode
+ * only pays off when the pass itself is expensive; raise -links to make
+ * each function larger.
+ *
+ * usage: cpass-split-bench [-functions=N] [-links=N] [-max-workers=N]
+ *                          [-partitions=N]
+ */
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "cpass.h"
+#include "split.h"
+
+using namespace llvm;
+using namespace std;
+
+static cl::opt<unsigned> nr_functions("functions",
+                                      cl::desc("functions in the module"),
+                                      cl::init(100000));
+static cl::opt<unsigned> nr_links(
+    "links", cl::desc("average conditional blocks per function"),
+    cl::init(4));
+static cl::opt<unsigned> max_workers(
+    "max-workers", cl::desc("largest number of workers (default: all cores)"),
+    cl::init(0));
+static cl::opt<unsigned> nr_partitions(
+    "partitions",
+    cl::desc("partitions per run (default: one per worker)"),
+    cl::init(0));
+
+static ExitOnError exit_on_err;
+
+/*
+ * makeModuleSource generates the benchmark module. Every function copies
+ * between a few locals across a short chain of blocks, like the functions
+ * in cpass-stress but smaller.
+ */
+static string makeModuleSource(unsigned nr_functions, unsigned avg_links) {
+  mt19937 rng(1);
+  string s;
+  raw_string_ostream os(s);
+
+  for (unsigned g = 0; g < 16; g++) {
+    os << "@g" << g << " = global i32 " << g << ", align 4\n";
+  }
+  for (unsigned f = 0; f < nr_functions; f++) {
+    unsigned nr_links = 1 + rng() % (2 * avg_links);
+    os << "\ndefine " << (f % 3 == 0 ? "internal " : "") << "i32 @f" << f
+       << "(i32 %n) {\n"
+       << "entry:\n"
+       << "  %a = alloca i32, align 4\n"
+       << "  %b = alloca i32, align 4\n"
+       << "  %ga = load i32, i32* @g" << f % 16 << ", align 4\n"
+       << "  store i32 %ga, i32* %a, align 4\n"
+       << "  store i32 %n, i32* %b, align 4\n"
+       << "  br label %link0\n";
+    for (unsigned l = 0; l < nr_links; l++) {
+      const char *src = rng() % 2 ? "%a" : "%b";
+      const char *dst = rng() % 2 ? "%a" : "%b";
+      os << "\nlink" << l << ":\n"
+         << "  %x" << l << " = load i32, i32* " << src << ", align 4\n"
+         << "  %y" << l << " = add i32 %x" << l << ", " << rng() % 10 << "\n"
+         << "  %c" << l << " = icmp slt i32 %y" << l << ", %n\n"
+         << "  br i1 %c" << l << ", label %side" << l << ", label %link"
+         << l + 1 << "\n"
+         << "\nside" << l << ":\n"
+         << "  store i32 %y" << l << ", i32* " << dst << ", align 4\n"
+         << "  br label %link" << l + 1 << "\n";
+    }
+    os << "\nlink" << nr_links << ":\n"
+       << "  %r = load i32, i32* %a, align 4\n";
+    if (f > 0) {
+      os << "  %call = call i32 @f" << f - 1 << "(i32 %r)\n"
+         << "  store i32 %call, i32* @g" << (f + 1) % 16 << ", align 4\n";
+    }
+    os << "  ret i32 %r\n"
+       << "}\n";
+  }
+  return os.str();
+}
+
+static std::unique_ptr<Module> loadModule(const SmallVectorImpl<char> &bitcode,
+                                          LLVMContext &ctx) {
+  return exit_on_err(parseBitcodeFile(
+      MemoryBufferRef(StringRef(bitcode.data(), bitcode.size()), "<bench>"),
+      ctx));
+}
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+  InitLLVM init(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv, "copy_prop split scaling benchmark\n");
+  exit_on_err.setBanner("cpass-split-bench: ");
+
+  SmallVector<char, 0> bitcode;
+  {
+    LLVMContext ctx;
+    SMDiagnostic err;
+    std::unique_ptr<Module> m = parseAssemblyString(
+        makeModuleSource(nr_functions, nr_links), err, ctx);
+    if (!m) {
+      err.print("cpass-split-bench", errs());
+      return 1;
+    }
+    raw_svector_ostream os(bitcode);
+    WriteBitcodeToFile(*m, os);
+  }
+
+  cpass::Options opts;
+  double sequential;
+  {
+    LLVMContext ctx;
+    std::unique_ptr<Module> m = loadModule(bitcode, ctx);
+    auto start = chrono::steady_clock::now();
+    for (Function &f : *m) {
+      if (!f.isDeclaration()) {
+        cpass::propagate(f, opts);
+      }
+    }
+    sequential = secondsSince(start);
+  }
+
+  unsigned limit = max_workers ? max_workers : thread::hardware_concurrency();
+  outs() << nr_functions << " functions, " << bitcode.size()
+         << " bytes of bitcode\n"
+         << "workers  partitions    seconds  speedup\n"
+         << format("in place %10s %10.2f %8.2f\n", (const char *)"-",
+                   sequential, 1.0);
+  for (unsigned workers = 1;; workers *= 2) {
+    workers = min(workers, limit);
+    unsigned partitions = nr_partitions ? nr_partitions : workers;
+    LLVMContext ctx;
+    std::unique_ptr<Module> m = loadModule(bitcode, ctx);
+    auto start = chrono::steady_clock::now();
+    m = exit_on_err(
+        cpass::propagateSplit(std::move(m), opts, partitions, workers));
+    double t = secondsSince(start);
+    outs() << format("%7u %11u %10.2f %8.2f\n", workers, partitions, t,
+                     sequential / t);
+    if (workers == limit) break;
+  }
+  return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef CPASS_H
+#define CPASS_H
+
+#include <atomic>
+#include <map>
+#include <vector>
+
+namespace llvm {
+class BasicBlock;
+class Function;
+class StoreInst;
+class Value;
+class raw_ostream;
+}  // namespace llvm
+
+/*
+ * Public interface of the copy propagation engine (the cpass library).
+ *
+ * This is the same code the copy_prop plugin runs inside opt, callable
+ * directly from other pipelines and JITs without a pass manager. All
+ * configuration is passed per call in an Options value and all state is
+ * released before a call returns, so functions in different LLVMContexts
+ * may be processed on different threads at the same time.
+ */
+namespace cpass {
+
+class LocalVariables;
+class ResultCache;
+
+/*
+ * ACPTable maps a copy destination (an address stored to, or a load that
+ * has been removed) to the value it currently holds. An available memset or
+ * memcpy maps to itself.
+ */
+typedef std::map<llvm::Value *, llvm::Value *> ACPTable;
+
+/*
+ * Stats counts what propagate did to every function it ran on with the same
+ * Stats. A Stats may be shared by threads.
+ */
+struct Stats {
+  // stores removed because their destination already held the value
+  std::atomic<unsigned> redundant_stores{0};
+};
+
+struct Options {
+  // run global copy propagation after the local phase
+  bool global = true;
+  // print the function after each phase, and the data-flow sets
+  bool verbose = false;
+  // where verbose output is written; errs() if null
+  llvm::raw_ostream *log = nullptr;
+  // reuse results for functions seen before; see result_cache.h
+  ResultCache *cache = nullptr;
+  // counts what propagate did, if not null
+  Stats *stats = nullptr;
+  // threads that solve the data-flow sets of a function of at least
+  // PARALLEL_MIN_BLOCKS blocks; see DataFlowAnalysis
+  unsigned int solver_threads = 1;
+};
+
+// the fewest blocks for which the data-flow sets are solved in parallel
+const unsigned int PARALLEL_MIN_BLOCKS = 4096;
+
+/*
+ * propagate runs copy propagation over F as configured by opts. Returns true
+ * if F was modified.
+ */
+bool propagate(llvm::Function &F, const Options &opts = Options());
+
+/*
+ * localCopyPropagation and globalCopyPropagation run a single phase of
+ * propagate over F. Returns true if F was modified.
+ */
+bool localCopyPropagation(llvm::Function &F, const Options &opts = Options());
+bool globalCopyPropagation(llvm::Function &F, const Options &opts = Options());
+
+/*
+ * propagateBlock propagates the copies in acp, and those made in bb itself,
+ * through bb and removes the loads made redundant. A store to one of the
+ * variables in locals that do not escape, of the value acp holds for it, is
+ * redundant too: it is removed, or if redundant_stores is not null, left in
+ * place and added to it for the caller to remove. Stores to other addresses
+ * are kept, since another pointer or a call may have written the address
+ * since. acp is updated with the copies available at the end of bb. Returns
+ * true if bb was modified.
+ */
+bool propagateBlock(llvm::BasicBlock &bb, ACPTable &acp,
+                    std::vector<llvm::StoreInst *> *redundant_stores = nullptr,
+                    const LocalVariables *locals = nullptr);
+
+}  // namespace cpass
+
+#endif  // CPASS_H
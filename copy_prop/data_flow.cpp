@@ -0,0 +1,1367 @@
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "data_flow.h"
+
+using namespace llvm;
+using namespace std;
+
+namespace cpass {
+
+// no copy is available; see availableCopy
+static const uint32_t NO_COPY = UINT32_MAX;
+// functions with at least this many blocks, and this many blocks for each
+// load from a copy destination, are queried on demand; see useOnDemand
+static const size_t DEMAND_MIN_BLOCKS = 256;
+static const size_t DEMAND_BLOCKS_PER_LOAD = 8;
+
+SetPool::SetPool(BumpPtrAllocator &arena, unsigned int nr_words)
+    : arena(arena), nr_words(nr_words) {
+  BitWord *words = arena.Allocate<BitWord>(nr_words);
+  memset(words, 0, nr_words * sizeof(BitWord));
+  empty_set = intern(words);
+}
+
+const BitWord *SetPool::intern(const BitWord *words) {
+  // the two largest keys are reserved by DenseMap
+  uint64_t hash = hash_combine_range(words, words + nr_words) >> 1;
+  SmallVector<const BitWord *, 1> &bucket = buckets[hash];
+  for (const BitWord *set : bucket) {
+    if (!memcmp(set, words, nr_words * sizeof(BitWord))) return set;
+  }
+  BitWord *set = arena.Allocate<BitWord>(nr_words);
+  memcpy(set, words, nr_words * sizeof(BitWord));
+  bucket.push_back(set);
+  return set;
+}
+
+/*
+ * initCopyIdxs creates a table that records unique identifiers for each copy
+ * (i.e., argument and store) instructions in LLVM.
+ *
+ * LLVM does not store the position of instructions in the Instruction class,
+ * so this routine is used to record unique identifiers for each copy
+ * instruction in the Function F. This step makes it easier to identify copy
+ * instructions in the COPY, KILL, CPIn, and CPOut sets.
+ *
+ * Copies are numbered by destination, in the order destinations first
+ * appear (arguments, then stores and range copies in reverse post order,
+ * then those in unreachable blocks), and in that order within a
+ * destination. A range copy is its own destination. The copies
+ * one store kills are then a single range of ids, and the bits a block
+ * touches are close together.
+ *
+ * Useful tips:
+ *
+ * You should record function arguments and store instructions as copy
+ * instructions.
+ *
+ * Some useful LLVM routines in this routine are:
+ *   Function::arg_iterator Function::arg_begin()
+ *   Function::arg_iterator Function::arg_end()
+ *   bool llvm::isa<T>(Instruction *)
+ */
+void DataFlowAnalysis::initCopyIdxs(Function &F) {
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  uint32_t nr_copies = 0;
+
+  // calls visit on every copy, in the order they are numbered
+  auto forEachCopy = [&](auto visit) {
+    auto visitStores = [&](BasicBlock *bb) {
+      for (Instruction &i : *bb) {
+        if (isa<StoreInst>(&i)) {
+          visit(Copy{&i, i.getOperand(1), bb, COPY_STORE});
+        } else if (isa<AnyMemIntrinsic>(&i)) {
+          mem_writes = true;
+          if (isRangeCopy(i, DL)) {
+            visit(Copy{&i, &i, bb, COPY_RANGE});
+          }
+        }
+      }
+    };
+    // add copy for all function args
+    for (auto ai = F.arg_begin(); ai != F.arg_end(); ai++) {
+      visit(Copy{&*ai, &*ai, nullptr, COPY_ARGUMENT});
+    }
+    for (BasicBlock *bb : rpo) {
+      visitStores(bb);
+    }
+    for (BasicBlock &bb : F) {
+      if (!block_idx.count(&bb)) {
+        visitStores(&bb);
+      }
+    }
+  };
+
+  // count the copies of every destination
+  forEachCopy([&](const Copy &copy) {
+    auto it = dest_group.insert({copy.dest, (uint32_t)group_begin.size()});
+    if (it.second) {
+      group_begin.push_back(0);
+    }
+    group_begin[it.first->second]++;
+    nr_copies++;
+  });
+
+  // turn group sizes into the first id of each group, then place the copies;
+  // placing moves each group's entry to the first id of the next group
+  uint32_t next = 0, size;
+  for (uint32_t &begin : group_begin) {
+    size = begin;
+    begin = next;
+    next += size;
+  }
+  copies.resize(nr_copies);
+  copy_idx.reserve(nr_copies);
+  forEachCopy([&](const Copy &copy) {
+    uint32_t idx = group_begin[dest_group[copy.dest]]++;
+    copies[idx] = copy;
+    copy_idx[copy.def] = idx;
+  });
+  group_begin.insert(group_begin.begin(), 0);
+}
+
+/*
+ * initObjectGroups lists the groups of stores and range copies under the
+ * objects of the bytes they write and, for a memcpy, read, and lists the
+ * groups of range copies, for killOverlapping.
+ */
+void DataFlowAnalysis::initObjectGroups() {
+  const DataLayout &DL = func.getParent()->getDataLayout();
+  for (uint32_t group = 0; group + 1 < group_begin.size(); group++) {
+    // a store to an argument shares its group
+    uint32_t id = group_begin[group];
+    while (id < group_begin[group + 1] && copies[id].kind == COPY_ARGUMENT) {
+      id++;
+    }
+    if (id == group_begin[group + 1]) continue;
+
+    Instruction &ins = *cast<Instruction>(copies[id].def);
+    Extent written = writtenExtent(ins, DL);
+    object_groups[written.object].push_back({group, written});
+    if (copies[id].kind != COPY_RANGE) continue;
+    range_groups.push_back(group);
+    if (auto *cpy = dyn_cast<MemCpyInst>(&ins)) {
+      Extent read = extentOf(cpy->getRawSource(),
+                             written.end - written.begin, DL);
+      object_groups[read.object].push_back({group, read});
+    }
+  }
+}
+
+/*
+ * initPreds records the reachable predecessors of every reachable block by
+ * their position in reverse post order, so that the solver does not need to
+ * look blocks up. Edges from unreachable blocks are left out: no copy
+ * reaches a block along them.
+ */
+void DataFlowAnalysis::initPreds() {
+  pred_begin.reserve(rpo.size() + 1);
+  preds.reserve(2 * rpo.size());
+  for (BasicBlock *bb : rpo) {
+    pred_begin.push_back(preds.size());
+    for (BasicBlock *pred : predecessors(bb)) {
+      auto it = block_idx.find(pred);
+      if (it != block_idx.end()) {
+        preds.push_back(it->second);
+      }
+    }
+  }
+  pred_begin.push_back(preds.size());
+}
+
+/*
+ * initCOPYAndKILLSets initializes the COPY and KILL sets for each basic block
+ * in the function F.
+ *
+ * Useful tips:
+ *
+ * This routine should visit the blocks in reverse post order. You can use an
+ * LLVM iterator to complete this traversal, e.g.:
+ *
+ *   BasicBlock *bb;
+ *   ReversePostOrderTraversal<Function*> RPOT(&F);
+ *   for ( auto BB = RPOT.begin(); BB != RPOT.end(); BB++ ) {
+ *       bb = *BB;
+ *       ...
+ *   }
+ *
+ * The BasicBlockInfo of each block is blocks[i], where i is the block's
+ * position in reverse post order.
+ *
+ * Some useful LLVM routines in this routine are:
+ *   bool llvm::isa<T>(Instruction *)
+ *   int  Instruction::getOperand(int)
+ */
+template <class Set>
+void DataFlowAnalysis::initCOPYAndKILLSets(BasicBlockInfo<Set> *blocks) {
+  for (uint32_t b = 0; b < rpo.size(); b++) {
+    addCOPYAndKILL(rpo[b], blocks[b].COPY, blocks[b].KILL);
+  }
+}
+
+/*
+ * killGroup kills the copies of group at the point in bb reached: a copy
+ * bb made before is not available at its end, and one it makes after is.
+ */
+template <class Set>
+void DataFlowAnalysis::killGroup(BasicBlock *bb, uint32_t group, Set &COPY,
+                                 Set &KILL) {
+  for (uint32_t id = group_begin[group]; id < group_begin[group + 1]; id++) {
+    if (copies[id].block != bb) {
+      KILL.set(id);
+    } else if (COPY.test(id)) {
+      COPY.reset(id);
+      KILL.set(id);
+    }
+  }
+}
+
+/*
+ * killOverlapping kills the groups of range copies other than self whose
+ * bytes overlap written, and if stores is set the groups of stores too.
+ * Stores to different addresses do not kill each other, even in the same
+ * bytes, as in propagateBlock.
+ */
+template <class Set>
+void DataFlowAnalysis::killOverlapping(BasicBlock *bb, const Extent &written,
+                                       uint32_t self, bool stores, Set &COPY,
+                                       Set &KILL) {
+  auto it = object_groups.find(written.object);
+  if (it == object_groups.end()) return;
+  for (auto &entry : it->second) {
+    uint32_t group = entry.first;
+    if (group == self || !entry.second.overlaps(written)) continue;
+    if (!stores && copies[group_begin[group]].kind != COPY_RANGE) continue;
+    killGroup(bb, group, COPY, KILL);
+  }
+}
+
+/*
+ * addCOPYAndKILL adds the copies made in bb to COPY, and the copies they
+ * kill to KILL. Returns true if bb makes or may kill any copies.
+ */
+template <class Set>
+bool DataFlowAnalysis::addCOPYAndKILL(BasicBlock *bb, Set &COPY, Set &KILL) {
+  const DataLayout &DL = func.getParent()->getDataLayout();
+  uint32_t idx, group, other;
+  bool found = false;
+
+  for (Instruction &ins : *bb) {
+    if (isa<StoreInst>(ins)) {
+      idx = copy_idx[&ins];
+      COPY.set(idx);
+      found = true;
+
+      // to generate KILL we need to get copies that modify the dest of
+      // a COPY outside of this block (including arguments, which are
+      // outside of every block); they are all in the group of its dest
+      group = dest_group[ins.getOperand(1)];
+      KILL.setRange(group_begin[group], group_begin[group + 1]);
+      for (other = group_begin[group]; other < group_begin[group + 1];
+           other++) {
+        // dont set the kill set for copies in this block, including this
+        // instruction
+        if (copies[other].block == bb) {
+          KILL.reset(other);
+        }
+      }
+      // copies update added to the group after its range
+      if (!group_extra.empty()) {
+        auto extra = group_extra.find(group);
+        if (extra != group_extra.end()) {
+          for (uint32_t other : extra->second) {
+            if (copies[other].block == bb) {
+              KILL.reset(other);
+            } else {
+              KILL.set(other);
+            }
+          }
+        }
+      }
+      // and the range copies that wrote or read its bytes
+      if (!range_groups.empty()) {
+        killOverlapping(bb, writtenExtent(ins, DL), group, false, COPY, KILL);
+      }
+    } else if (mem_writes && isa<AnyMemIntrinsic>(ins)) {
+      // a memory intrinsic kills the copies to the bytes it writes, whatever
+      // their address, and may make a range copy itself
+      group = UINT32_MAX;
+      auto it = copy_idx.find(&ins);
+      if (it != copy_idx.end()) {
+        COPY.set(it->second);
+        group = dest_group[&ins];
+      }
+      killOverlapping(bb, writtenExtent(ins, DL), group, true, COPY, KILL);
+      found = true;
+    } else if (!range_groups.empty() && ins.mayWriteToMemory()) {
+      // a call may write any of the bytes of a range copy
+      for (uint32_t range : range_groups) {
+        killGroup(bb, range, COPY, KILL);
+      }
+      found = true;
+    }
+  }
+  return found;
+}
+
+/*
+ * initSlicedCOPYAndKILLSets is the version of initCOPYAndKILLSets for
+ * SharedBitSets. It builds each block's sets in scratch sets and interns
+ * every slice of them in the slice's pool. Blocks without copies share the
+ * empty set. If only is not null, only the blocks in it are rebuilt.
+ */
+void DataFlowAnalysis::initSlicedCOPYAndKILLSets(const vector<uint32_t> *only) {
+  BitSet copy(arena, capacity), kill(arena, capacity);
+  size_t bytes = copy.numWords() * sizeof(BitWord);
+  uint32_t i, b, s, n = only ? only->size() : rpo.size();
+
+  for (i = 0; i < n; i++) {
+    b = only ? (*only)[i] : i;
+    bool found = addCOPYAndKILL(rpo[b], copy, kill);
+    for (s = 0; s < slices.size(); s++) {
+      BasicBlockInfo<SharedBitSet> &bbi = slices[s][b];
+      SetPool &pool = *pools[s];
+      bbi.COPY.words = bbi.KILL.words = pool.empty();
+      if (found) {
+        bbi.COPY.words = pool.intern(copy.data() + s * slice_words);
+        bbi.KILL.words = pool.intern(kill.data() + s * slice_words);
+      }
+    }
+    if (found) {
+      memset(copy.data(), 0, bytes);
+      memset(kill.data(), 0, bytes);
+    }
+  }
+}
+
+/*
+ * initCPInAndCPOutSets initializes the CPIn and CPOut sets for each basic
+ * block in the function F.
+ *
+ * Useful tips:
+ *
+ * Similar to initCOPYAndKillSets, you will need to traverse the blocks in
+ * reverse post order.
+ *
+ * You can iterate the predecessors and successors of a block bb using
+ * LLVM-defined iterators "predecessors" and "successors", e.g.:
+ *
+ *   for ( BasicBlock* pred : predecessors( bb ) ) {
+ *       // pred points to a predecessor of bb
+ *       ...
+ *   }
+ *
+ * You will need to define a special case for the entry block (and some way to
+ * identify the entry block).
+ *
+ *
+ * Use set operations on the appropriate BitVector to create CPIn and CPOut.
+ *
+ * If region is not null only the blocks in it, in reverse post order, are
+ * solved. Their sets must be empty, and no block outside it may be reachable
+ * from one inside it, so that the sets of the other blocks are final.
+ */
+template <class Set>
+void DataFlowAnalysis::initCPInAndCPOutSets(BasicBlockInfo<Set> *blocks,
+                                            const vector<uint32_t> *region) {
+  solveForward(blocks, pred_begin.data(), preds.data(), rpo.size(), region);
+}
+
+/*
+ * solveForward finds the greatest fixed point of CPIn(b) = the intersection
+ * of CPOut(p) over the predecessors p of b, CPOut(b) = COPY(b) | (CPIn(b) &
+ * ~KILL(b)), for the blocks [0, nr_blocks), in reverse post order. See
+ * data_flow.h.
+ */
+template <class Set>
+void solveForward(BasicBlockInfo<Set> *blocks, const uint32_t *pred_begin,
+                  const uint32_t *preds, uint32_t nr_blocks,
+                  const vector<uint32_t> *region) {
+  BitWord *in, *out, old;
+  const BitWord *pout, *copy, *kill;
+  uint32_t i, b, p, n = region ? region->size() : nr_blocks;
+  unsigned int w, nr_words = blocks[0].CPIn.numWords();
+
+  bool changed = false;
+  bool initial = true;
+
+loop:
+  do {
+    changed = false;
+    for (i = 0; i < n; i++) {
+      b = region ? (*region)[i] : i;
+      BasicBlockInfo<Set> &bbi = blocks[b];
+      in = bbi.CPIn.data();
+
+      // the sets only grow in the initial pass and only shrink after it,
+      // so any word that changes on the way means the set changed
+      for (p = pred_begin[b]; p < pred_begin[b + 1]; p++) {
+        pout = blocks[preds[p]].CPOut.data();
+        for (w = 0; w < nr_words; w++) {
+          old = in[w];
+          // words with no bits to add or remove are left alone; with copies
+          // grouped by destination most of them are
+          if (initial) {
+            // during initial DFA create union of possible CPIn sets
+            if (!pout[w]) continue;
+            in[w] |= pout[w];
+          } else {
+            // after initial pass, only set CPIn to CPOut from all preds
+            if (!old) continue;
+            in[w] &= pout[w];
+          }
+          changed |= in[w] != old;
+        }
+      }
+
+      // compute cpout using book alg
+      out = bbi.CPOut.data();
+      copy = bbi.COPY.data();
+      kill = bbi.KILL.data();
+      for (w = 0; w < nr_words; w++) {
+        old = out[w];
+        out[w] = copy[w] | (in[w] & ~kill[w]);
+        changed |= out[w] != old;
+      }
+    }
+  } while (changed);
+
+  // after initial DFA, go back and compute CPIn and CPOut
+  if (initial) {
+    initial = false;
+    goto loop;
+  }
+}
+
+template void solveForward(BasicBlockInfo<FixedBitSet<1>> *, const uint32_t *,
+                           const uint32_t *, uint32_t,
+                           const vector<uint32_t> *);
+template void solveForward(BasicBlockInfo<FixedBitSet<4>> *, const uint32_t *,
+                           const uint32_t *, uint32_t,
+                           const vector<uint32_t> *);
+template void solveForward(BasicBlockInfo<BitSet> *, const uint32_t *,
+                           const uint32_t *, uint32_t,
+                           const vector<uint32_t> *);
+
+/*
+ * solveBackward finds the least fixed point of CPOut(b) = the union of
+ * CPIn(s) over the successors s of b, CPIn(b) = COPY(b) | (CPOut(b) &
+ * ~KILL(b)), visiting the blocks in post order. The sets only grow, so a
+ * pass that changes no CPIn is the last. For MEET_INTERSECTION it then
+ * goes on from that solution as solveForward does, intersecting instead,
+ * until the sets stop shrinking: starting from the union rather than from
+ * full sets keeps a loop that never exits from anticipating everything.
+ * See data_flow.h.
+ */
+template <class Set>
+void solveBackward(BasicBlockInfo<Set> *blocks, const uint32_t *succ_begin,
+                   const uint32_t *succs, uint32_t nr_blocks, Meet meet) {
+  BitWord *in, *out, old;
+  const BitWord *sin, *use, *def;
+  uint32_t b, s;
+  unsigned int w, nr_words = blocks[0].CPIn.numWords();
+  bool changed;
+  bool initial = true;
+
+loop:
+  do {
+    changed = false;
+    for (b = nr_blocks; b-- > 0;) {
+      BasicBlockInfo<Set> &bbi = blocks[b];
+      out = bbi.CPOut.data();
+      for (s = succ_begin[b]; s < succ_begin[b + 1]; s++) {
+        sin = blocks[succs[s]].CPIn.data();
+        if (initial) {
+          for (w = 0; w < nr_words; w++) {
+            out[w] |= sin[w];
+          }
+        } else {
+          for (w = 0; w < nr_words; w++) {
+            out[w] &= sin[w];
+          }
+        }
+      }
+
+      in = bbi.CPIn.data();
+      use = bbi.COPY.data();
+      def = bbi.KILL.data();
+      for (w = 0; w < nr_words; w++) {
+        old = in[w];
+        in[w] = use[w] | (out[w] & ~def[w]);
+        changed |= in[w] != old;
+      }
+    }
+  } while (changed);
+
+  if (initial && meet == MEET_INTERSECTION) {
+    initial = false;
+    goto loop;
+  }
+}
+
+template void solveBackward(BasicBlockInfo<FixedBitSet<1>> *,
+                            const uint32_t *, const uint32_t *, uint32_t,
+                            Meet);
+template void solveBackward(BasicBlockInfo<FixedBitSet<4>> *,
+                            const uint32_t *, const uint32_t *, uint32_t,
+                            Meet);
+template void solveBackward(BasicBlockInfo<BitSet> *, const uint32_t *,
+                            const uint32_t *, uint32_t, Meet);
+
+/*
+ * The CFGNumbering constructor numbers the blocks of F reachable from its
+ * entry in reverse post order and records the edges between them.
+ */
+CFGNumbering::CFGNumbering(Function &F) {
+  for (BasicBlock *bb : ReversePostOrderTraversal<Function *>(&F)) {
+    block_idx[bb] = rpo.size();
+    rpo.push_back(bb);
+  }
+  for (BasicBlock *bb : rpo) {
+    pred_begin.push_back(preds.size());
+    for (BasicBlock *pred : predecessors(bb)) {
+      auto it = block_idx.find(pred);
+      if (it != block_idx.end()) {
+        preds.push_back(it->second);
+      }
+    }
+    succ_begin.push_back(succs.size());
+    for (BasicBlock *succ : successors(bb)) {
+      succs.push_back(block_idx[succ]);
+    }
+  }
+  pred_begin.push_back(preds.size());
+  succ_begin.push_back(succs.size());
+}
+
+/*
+ * This version of initCPInAndCPOutSets computes the same fixed point with
+ * interned sets. Since an interned set is never modified, every new CPIn or
+ * CPOut is built in a scratch set and interned, and a set has changed if
+ * its pointer has. Blocks with a single predecessor take its CPOut (the
+ * meet with their previous CPIn, which the CPOut contains in the initial
+ * pass and is contained in after it, leaves it unchanged), and blocks
+ * without copies pass their CPIn on as CPOut, so neither computes a set.
+ *
+ * It solves one slice of the sets (see solveSlices), interned in pool, and
+ * only touches the slice and the pool.
+ */
+void DataFlowAnalysis::initCPInAndCPOutSets(
+    BasicBlockInfo<SharedBitSet> *blocks, SetPool &pool,
+    const vector<uint32_t> *region) {
+  unsigned int w, nr_words = pool.numWords();
+  vector<BitWord> scratch_words(nr_words);
+  BitWord *scratch = scratch_words.data();
+  const BitWord *in, *out, *pout, *copy, *kill;
+  uint32_t i, b, p, n = region ? region->size() : rpo.size();
+
+  bool changed = false;
+  bool initial = true;
+
+  for (i = 0; i < n; i++) {
+    b = region ? (*region)[i] : i;
+    blocks[b].CPIn.words = blocks[b].CPOut.words = pool.empty();
+  }
+
+loop:
+  do {
+    changed = false;
+    for (i = 0; i < n; i++) {
+      b = region ? (*region)[i] : i;
+      BasicBlockInfo<SharedBitSet> &bbi = blocks[b];
+      in = bbi.CPIn.words;
+
+      if (pred_begin[b + 1] - pred_begin[b] == 1) {
+        in = blocks[preds[pred_begin[b]]].CPOut.words;
+      } else if (pred_begin[b + 1] > pred_begin[b]) {
+        memcpy(scratch, in, nr_words * sizeof(BitWord));
+        for (p = pred_begin[b]; p < pred_begin[b + 1]; p++) {
+          pout = blocks[preds[p]].CPOut.words;
+          if (initial) {
+            // during initial DFA create union of possible CPIn sets
+            for (w = 0; w < nr_words; w++) scratch[w] |= pout[w];
+          } else {
+            // after initial pass, only set CPIn to CPOut from all preds
+            for (w = 0; w < nr_words; w++) scratch[w] &= pout[w];
+          }
+        }
+        in = pool.intern(scratch);
+      }
+
+      // compute cpout using book alg
+      copy = bbi.COPY.words;
+      kill = bbi.KILL.words;
+      if (copy == pool.empty() && kill == pool.empty()) {
+        out = in;
+      } else {
+        for (w = 0; w < nr_words; w++) {
+          scratch[w] = copy[w] | (in[w] & ~kill[w]);
+        }
+        out = pool.intern(scratch);
+      }
+
+      changed |= in != bbi.CPIn.words || out != bbi.CPOut.words;
+      bbi.CPIn.words = in;
+      bbi.CPOut.words = out;
+    }
+  } while (changed);
+
+  // after initial DFA, go back and compute CPIn and CPOut
+  if (initial) {
+    initial = false;
+    goto loop;
+  }
+}
+
+/*
+ * solve runs the analysis with the sets of every block held in a Set. The
+ * block infos are allocated together from the arena before the sets are
+ * solved, so solving itself allocates nothing; for a FixedBitSet that is
+ * all of the memory the sets need.
+ */
+template <class Set>
+void DataFlowAnalysis::solve() {
+  BasicBlockInfo<Set> *blocks = arena.Allocate<BasicBlockInfo<Set>>(rpo.size());
+  for (uint32_t b = 0; b < rpo.size(); b++) {
+    new (&blocks[b]) BasicBlockInfo<Set>(arena, copies.size());
+  }
+  sets = new (arena.Allocate<BlockSetsImpl<Set>>()) BlockSetsImpl<Set>(blocks);
+
+  initCOPYAndKILLSets(blocks);
+  initCPInAndCPOutSets(blocks);
+}
+
+/*
+ * solve for SharedBitSets splits the sets into one slice of words per
+ * thread, and interns every slice in a pool that is kept with the analysis,
+ * for update; the sets themselves stay in the arenas.
+ */
+template <>
+void DataFlowAnalysis::solve<SharedBitSet>() {
+  unsigned int nr_words = capacity / WORD_BITS;
+  unsigned int nr_slices = std::max(1u, std::min(threads, nr_words));
+  slice_words = (nr_words + nr_slices - 1) / nr_slices;
+  nr_slices = (nr_words + slice_words - 1) / slice_words;
+
+  for (unsigned int s = 0; s < nr_slices; s++) {
+    BasicBlockInfo<SharedBitSet> *blocks =
+        arena.Allocate<BasicBlockInfo<SharedBitSet>>(rpo.size());
+    for (uint32_t b = 0; b < rpo.size(); b++) {
+      new (&blocks[b]) BasicBlockInfo<SharedBitSet>(arena, copies.size());
+    }
+    slices.push_back(blocks);
+    if (s > 0) {
+      slice_arenas.emplace_back(new BumpPtrAllocator());
+    }
+    pools.emplace_back(new SetPool(s > 0 ? *slice_arenas.back() : arena,
+                                   std::min(slice_words,
+                                            nr_words - s * slice_words)));
+  }
+  sets = new (arena.Allocate<SlicedSets>())
+      SlicedSets(slices.data(), nr_slices, slice_words, nr_words,
+                 arena.Allocate<BitWord>(nr_words));
+
+  initSlicedCOPYAndKILLSets();
+  solveSlices();
+}
+
+/*
+ * solveSlices solves the CPIn and CPOut sets of every slice, of the blocks
+ * in region or of all blocks. The meet and the transfer function work bit
+ * by bit, so every bit of the sets is a separate problem, and a slice
+ * reaches the same fixed point alone as the sets do as a whole. The slices
+ * only share the CFG, which is not written, and each is solved on its own
+ * thread.
+ */
+void DataFlowAnalysis::solveSlices(const vector<uint32_t> *region) {
+  vector<thread> workers;
+  for (uint32_t s = 1; s < slices.size(); s++) {
+    workers.emplace_back([this, s, region] {
+      initCPInAndCPOutSets(slices[s], *pools[s], region);
+    });
+  }
+  initCPInAndCPOutSets(slices[0], *pools[0], region);
+  for (thread &worker : workers) {
+    worker.join();
+  }
+}
+
+/*
+ * resolve recomputes the COPY and KILL sets of the modified blocks, adds each
+ * (block, id) of kills, sorted by block, to that block's KILL set, and then
+ * recomputes the CPIn and CPOut sets of the blocks in region, which holds
+ * every block reachable from a modified one, in reverse post order.
+ */
+template <class Set>
+void DataFlowAnalysis::resolve(const vector<uint32_t> &modified,
+                               const vector<pair<uint32_t, uint32_t>> &kills,
+                               const vector<uint32_t> &region) {
+  BasicBlockInfo<Set> *blocks = static_cast<BlockSetsImpl<Set> *>(sets)->blocks;
+  for (uint32_t b : modified) {
+    blocks[b].COPY.clear();
+    blocks[b].KILL.clear();
+    addCOPYAndKILL(rpo[b], blocks[b].COPY, blocks[b].KILL);
+  }
+  for (auto &kill : kills) {
+    blocks[kill.first].KILL.set(kill.second);
+  }
+  for (uint32_t b : region) {
+    blocks[b].CPIn.clear();
+    blocks[b].CPOut.clear();
+  }
+  initCPInAndCPOutSets(blocks, &region);
+}
+
+template <>
+void DataFlowAnalysis::resolve<SharedBitSet>(
+    const vector<uint32_t> &modified,
+    const vector<pair<uint32_t, uint32_t>> &kills,
+    const vector<uint32_t> &region) {
+  initSlicedCOPYAndKILLSets(&modified);
+
+  // each slice of a block's KILL set is copied once for all of its new ids
+  vector<BitWord> kill(slice_words);
+  for (size_t k = 0; k < kills.size();) {
+    uint32_t b = kills[k].first;
+    uint32_t s = kills[k].second / WORD_BITS / slice_words;
+    uint32_t first_bit = s * slice_words * WORD_BITS;
+    SetPool &pool = *pools[s];
+    memcpy(kill.data(), slices[s][b].KILL.words,
+           pool.numWords() * sizeof(BitWord));
+    for (; k < kills.size() && kills[k].first == b &&
+           kills[k].second / WORD_BITS / slice_words == s;
+         k++) {
+      uint32_t bit = kills[k].second - first_bit;
+      kill[bit / WORD_BITS] |= BitWord(1) << (bit % WORD_BITS);
+    }
+    slices[s][b].KILL.words = pool.intern(kill.data());
+  }
+  solveSlices(&region);
+}
+
+/*
+ * initACP builds the ACP table of a single block in acp from its CPIn set,
+ * using the current source operand of each available copy.
+ *
+ * Useful tips:
+ *
+ * You will need to use CPIn to determine if a copy should be in the ACP for
+ * this block.
+ */
+void DataFlowAnalysis::initACP(unsigned int block, ACPTable &acp) {
+  const BitWord *in = sets->getWords(block, BlockSets::CP_IN);
+  acp.clear();
+  for (uint32_t i = 0; i < copies.size(); i++) {
+    if ((in[i / WORD_BITS] >> (i % WORD_BITS)) & 1) {
+      acp[copies[i].dest] = copies[i].source();
+    }
+  }
+}
+
+/*
+ * useOnDemand returns true if getACP is to be answered on demand: unless the
+ * mode says otherwise, if the function is large and has few loads from copy
+ * destinations for its size, so that that costs less than solving the sets
+ * of every block. availableCopy only follows the kills within a group, so
+ * a function with memory intrinsics is always solved.
+ */
+bool DataFlowAnalysis::useOnDemand() {
+  if (mem_writes) return false;
+  if (mode != AUTO) return mode == ON_DEMAND;
+  if (rpo.size() < DEMAND_MIN_BLOCKS) return false;
+  size_t nr_loads = 0, max_loads = rpo.size() / DEMAND_BLOCKS_PER_LOAD;
+  for (BasicBlock *bb : rpo) {
+    for (Instruction &ins : *bb) {
+      auto *load = dyn_cast<LoadInst>(&ins);
+      if (load && dest_group.count(load->getPointerOperand()) &&
+          ++nr_loads > max_loads) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/*
+ * availableCopy returns the id of the copy of the destination of group in
+ * the ACP table of block, or NO_COPY, without the sets.
+ *
+ * Every store to a destination kills the copies to it made in other blocks,
+ * so a block's CPOut holds, of a group, either the block's own copies or,
+ * if it makes none, its CPIn. The copies in CPIn are then those made by the
+ * blocks that store to the destination and are found first on the paths
+ * leading back from the block: if there is only one such block, and no path
+ * reaches the entry block without meeting one, its copies are in CPIn, of
+ * which the table holds its last; otherwise there are none. availableCopy
+ * walks back over the predecessors to find them, visiting each block once,
+ * and stops as soon as the answer is none.
+ *
+ * Every block it walked over has the same answer when there is a copy, and
+ * they are all remembered; a remembered block is not walked over again.
+ */
+uint32_t DataFlowAnalysis::availableCopy(uint32_t group, uint32_t block) {
+  uint64_t key = (uint64_t)group << 32 | block;
+  auto memo = available.find(key);
+  if (memo != available.end()) return memo->second;
+
+  // the blocks that store to the destination, with their last copy
+  auto defs = group_defs.find(group);
+  if (defs == group_defs.end()) {
+    SmallVector<pair<uint32_t, uint32_t>, 4> blocks;
+    auto addDef = [&](uint32_t id) {
+      if (copies[id].kind != COPY_STORE) return;
+      auto it = block_idx.find(copies[id].block);
+      if (it != block_idx.end()) blocks.push_back({it->second, id});
+    };
+    for (uint32_t id = group_begin[group]; id < group_begin[group + 1]; id++) {
+      addDef(id);
+    }
+    if (!group_extra.empty()) {
+      auto extra = group_extra.find(group);
+      if (extra != group_extra.end()) {
+        for (uint32_t id : extra->second) addDef(id);
+      }
+    }
+    // the last copy of each block sorts last among the block's
+    std::sort(blocks.begin(), blocks.end());
+    SmallVector<pair<uint32_t, uint32_t>, 4> last;
+    for (auto &def : blocks) {
+      if (!last.empty() && last.back().first == def.first) {
+        last.back() = def;
+      } else {
+        last.push_back(def);
+      }
+    }
+    defs = group_defs.insert({group, std::move(last)}).first;
+  }
+  auto findDef = [&](uint32_t b) {
+    auto it = std::lower_bound(defs->second.begin(), defs->second.end(),
+                               make_pair(b, uint32_t(0)));
+    return it != defs->second.end() && it->first == b ? it->second : NO_COPY;
+  };
+
+  // a new mark for the blocks visited by this walk
+  if (++visit == 0) {
+    std::fill(visited.begin(), visited.end(), 0);
+    visit = 1;
+  }
+  SmallVector<uint32_t, 32> work, walked;
+  auto visitPreds = [&](uint32_t b) {
+    for (uint32_t p = pred_begin[b]; p < pred_begin[b + 1]; p++) {
+      if (visited[preds[p]] != visit) {
+        visited[preds[p]] = visit;
+        work.push_back(preds[p]);
+      }
+    }
+  };
+
+  uint32_t copy = NO_COPY, found;
+  bool none = defs->second.empty();
+  visitPreds(block);
+  while (!work.empty() && !none) {
+    uint32_t b = work.pop_back_val();
+    found = findDef(b);
+    if (found == NO_COPY) {
+      // the entry block makes no copies to the destination
+      if (b == 0) {
+        none = true;
+        continue;
+      }
+      memo = available.find((uint64_t)group << 32 | b);
+      if (memo == available.end()) {
+        walked.push_back(b);
+        visitPreds(b);
+        continue;
+      }
+      found = memo->second;
+      none = found == NO_COPY;
+    }
+    if (copy != NO_COPY && found != copy) none = true;
+    copy = found;
+  }
+
+  // the entry block has no predecessors, and so no copies in CPIn
+  if (none || copy == NO_COPY) {
+    available[key] = NO_COPY;
+    return NO_COPY;
+  }
+  available[key] = copy;
+  for (uint32_t b : walked) {
+    available[(uint64_t)group << 32 | b] = copy;
+  }
+  return copy;
+}
+
+/*
+ * initDemandedACP builds the ACP table of bb, the block at position block in
+ * reverse post order, with availableCopy. Only the entries propagateBlock can
+ * tell from missing ones are built: those for the operands of the block's
+ * instructions up to the first store to them in the block, which replaces
+ * the entry. A store looks up the entry for its address only to remove the
+ * entries it is the value of, so its address is only needed if it is stored
+ * as a value somewhere (see stored_dests).
+ */
+void DataFlowAnalysis::initDemandedACP(BasicBlock &bb, uint32_t block,
+                                       ACPTable &acp) {
+  SmallPtrSet<Value *, 16> seen;
+  acp.clear();
+  for (Instruction &ins : bb) {
+    auto *store = dyn_cast<StoreInst>(&ins);
+    for (Use &op : ins.operands()) {
+      if (store && op.getOperandNo() == 1 && !stored_dests.count(op)) {
+        seen.insert(op);
+        continue;
+      }
+      if (!seen.insert(op).second) continue;
+      auto group = dest_group.find(op);
+      if (group == dest_group.end()) continue;
+      uint32_t id = availableCopy(group->second, block);
+      if (id != NO_COPY) {
+        acp[op] = copies[id].source();
+      }
+    }
+  }
+}
+
+/*
+ * addStoredDests adds the copy destinations stored as values by the stores
+ * of bb to stored_dests.
+ */
+void DataFlowAnalysis::addStoredDests(BasicBlock &bb) {
+  for (Instruction &ins : bb) {
+    auto *store = dyn_cast<StoreInst>(&ins);
+    if (store && dest_group.count(store->getValueOperand())) {
+      stored_dests.insert(store->getValueOperand());
+    }
+  }
+}
+
+/*
+ * getACP returns the ACP table for bb. The table is built on every call:
+ * global propagation rewrites the sources of copies as it goes, and removes
+ * the loads they were copied from, so a table built up front may refer to
+ * instructions that no longer exist. Without sets, only the entries for the
+ * addresses bb uses are built.
+ */
+ACPTable DataFlowAnalysis::getACP(BasicBlock &bb) {
+  ACPTable acp;
+  auto it = block_idx.find(&bb);
+  if (it == block_idx.end()) {
+    return acp;
+  }
+  if (set_kind == SETS_ON_DEMAND) {
+    initDemandedACP(bb, it->second, acp);
+  } else {
+    initACP(it->second, acp);
+  }
+  return acp;
+}
+
+/*
+ * printOrder returns the copy ids in the order their copies appear in the
+ * function: arguments, then instructions in layout order, then the ids of
+ * removed copies. The dumps list copies in this order, so they do not
+ * depend on how ids are assigned.
+ */
+vector<uint32_t> DataFlowAnalysis::printOrder() {
+  vector<uint32_t> order;
+  order.reserve(copies.size());
+  auto add = [&](Value *def) {
+    auto it = copy_idx.find(def);
+    if (it != copy_idx.end()) order.push_back(it->second);
+  };
+  for (Argument &arg : func.args()) {
+    add(&arg);
+  }
+  for (BasicBlock &bb : func) {
+    for (Instruction &i : bb) {
+      add(&i);
+    }
+  }
+  for (uint32_t i = 0; i < copies.size(); i++) {
+    if (copies[i].kind == COPY_REMOVED) order.push_back(i);
+  }
+  return order;
+}
+
+void DataFlowAnalysis::printCopyIdxs(raw_ostream &os) {
+  os << "copy_idx:"
+         << "\n";
+  vector<uint32_t> order = printOrder();
+  for (uint32_t i = 0; i < order.size(); i++) {
+    os << "  " << format("%-3d", i) << " --> ";
+    if (copies[order[i]].kind == COPY_REMOVED) {
+      os << "removed\n";
+    } else {
+      os << *copies[order[i]].def << "\n";
+    }
+  }
+  os << "\n";
+}
+
+/*
+ * printSet prints the bits of the set in words, in the given order of ids.
+ */
+static void printSet(raw_ostream &os, const char *name, const BitWord *words,
+                     const vector<uint32_t> &order) {
+  os << "  " << name;
+  for (uint32_t i : order) {
+    os << ((words[i / WORD_BITS] >> (i % WORD_BITS)) & 1) << ' ';
+  }
+  os << "\n";
+}
+
+void DataFlowAnalysis::printDFA(raw_ostream &os) {
+  if (!sets) {
+    os << "sets not solved; ACP tables are found on demand\n";
+    return;
+  }
+  // used for formatting
+  std::string str;
+  llvm::raw_string_ostream rso(str);
+  ACPTable acp;
+  vector<uint32_t> order = printOrder();
+
+  // blocks in layout order; unreachable blocks have no sets
+  for (BasicBlock &bb : func) {
+    auto it = block_idx.find(&bb);
+    if (it == block_idx.end()) continue;
+    unsigned int b = it->second;
+    initACP(b, acp);
+
+    os << "BB ";
+    bb.printAsOperand(os, false);
+    os << "\n";
+
+    printSet(os, "CPIn  ", sets->getWords(b, BlockSets::CP_IN), order);
+    printSet(os, "CPOut ", sets->getWords(b, BlockSets::CP_OUT), order);
+    printSet(os, "COPY  ", sets->getWords(b, BlockSets::COPY), order);
+    printSet(os, "KILL  ", sets->getWords(b, BlockSets::KILL), order);
+
+    os << "  ACP:"
+           << "\n";
+    for (auto it = acp.begin(); it != acp.end(); ++it) {
+      rso << *(it->first);
+      os << "  " << format("%-30s", rso.str().c_str())
+             << "==  " << *(it->second) << "\n";
+      str.clear();
+    }
+    os << "\n"
+           << "\n";
+  }
+}
+
+/*
+ * build numbers the copies of the function and solves the sets of its blocks
+ * from scratch, releasing any earlier numbering and sets.
+ */
+void DataFlowAnalysis::build() {
+  copies.clear();
+  copy_idx.clear();
+  dest_group.clear();
+  group_begin.clear();
+  group_extra.clear();
+  rpo.clear();
+  block_idx.clear();
+  pred_begin.clear();
+  preds.clear();
+  nr_succs.clear();
+  slices.clear();
+  pools.clear();
+  slice_arenas.clear();
+  available.clear();
+  group_defs.clear();
+  visited.clear();
+  stored_dests.clear();
+  mem_writes = false;
+  object_groups.clear();
+  range_groups.clear();
+  sets = nullptr;
+  arena.Reset();
+
+  // the same order as a ReversePostOrderTraversal, without its copy
+  rpo.reserve(func.size());
+  for (BasicBlock *bb : post_order(&func)) {
+    rpo.push_back(bb);
+  }
+  std::reverse(rpo.begin(), rpo.end());
+  block_idx.reserve(rpo.size());
+  for (uint32_t b = 0; b < rpo.size(); b++) {
+    block_idx[rpo[b]] = b;
+  }
+
+  initCopyIdxs(func);
+  initPreds();
+  if (mem_writes) {
+    initObjectGroups();
+  }
+
+  // the bit-set type is picked from the number of copies; update keeps it
+  // until the copies no longer fit
+  if (useOnDemand()) {
+    set_kind = SETS_ON_DEMAND;
+    capacity = UINT32_MAX;
+    visited.assign(rpo.size(), 0);
+    visit = 0;
+    for (BasicBlock &bb : func) {
+      addStoredDests(bb);
+    }
+  } else if (copies.size() <= WORD_BITS) {
+    set_kind = SETS_FIXED_1;
+    capacity = WORD_BITS;
+    solve<FixedBitSet<1>>();
+  } else if (copies.size() <= 4 * WORD_BITS) {
+    set_kind = SETS_FIXED_4;
+    capacity = 4 * WORD_BITS;
+    solve<FixedBitSet<4>>();
+  } else {
+    set_kind = SETS_SHARED;
+    capacity = (copies.size() + WORD_BITS - 1) / WORD_BITS * WORD_BITS;
+    solve<SharedBitSet>();
+  }
+}
+
+/*
+ * successorsChanged returns true if the edges out of bb, the reachable block
+ * b, are not the ones recorded in the predecessor lists.
+ */
+bool DataFlowAnalysis::successorsChanged(BasicBlock *bb, uint32_t b) {
+  SmallDenseMap<BasicBlock *, uint32_t, 4> edges;
+  uint32_t nr_edges = 0;
+  for (BasicBlock *succ : successors(bb)) {
+    edges[succ]++;
+    nr_edges++;
+  }
+  if (nr_edges != nr_succs[b]) return true;
+
+  for (auto &edge : edges) {
+    auto it = block_idx.find(edge.first);
+    if (it == block_idx.end()) return true;
+    uint32_t s = it->second;
+    if (std::count(&preds[pred_begin[s]], &preds[pred_begin[s + 1]], b) !=
+        edge.second) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * renumberStores gives ids to the stores of the modified blocks, keeping the
+ * ids of every other copy. The old ids of the blocks' stores are freed, and
+ * each store takes the lowest free id in the group of its destination that
+ * is above the ids of the earlier stores to it in the block, so that, as in a
+ * new numbering, the last store to a destination in a block has the largest
+ * id. A store with no such id gets a new one at the end of the table, which
+ * is added to added: the blocks of the other copies in its group do not
+ * kill it yet. Returns false if the table no longer fits in the sets.
+ */
+bool DataFlowAnalysis::renumberStores(ArrayRef<BasicBlock *> modified,
+                                      SmallVectorImpl<uint32_t> &added) {
+  SmallPtrSet<BasicBlock *, 8> blocks(modified.begin(), modified.end());
+  for (Copy &copy : copies) {
+    if (copy.kind == COPY_STORE && blocks.count(copy.block)) {
+      copy_idx.erase(copy.def);
+      copy = Copy{nullptr, nullptr, nullptr, COPY_REMOVED};
+    }
+  }
+
+  // the lowest id the next store to each group in the block may take
+  SmallDenseMap<uint32_t, uint32_t, 8> next_id;
+  for (BasicBlock *bb : modified) {
+    // blocks listed twice are numbered once
+    if (!blocks.erase(bb)) continue;
+    next_id.clear();
+    for (Instruction &i : *bb) {
+      if (!isa<StoreInst>(&i)) continue;
+      Value *dest = i.getOperand(1);
+      auto it = dest_group.insert({dest, (uint32_t)group_begin.size() - 1});
+      if (it.second) {
+        group_begin.push_back(group_begin.back());
+      }
+      uint32_t group = it.first->second;
+      uint32_t min_id = std::max(next_id.lookup(group), group_begin[group]);
+      uint32_t idx = UINT32_MAX;
+
+      for (uint32_t id = min_id; id < group_begin[group + 1]; id++) {
+        if (copies[id].kind == COPY_REMOVED) {
+          idx = id;
+          break;
+        }
+      }
+      if (idx == UINT32_MAX) {
+        // extra ids are larger than the range and in increasing order
+        SmallVector<uint32_t, 2> &extra = group_extra[group];
+        for (uint32_t id : extra) {
+          if (id >= min_id && copies[id].kind == COPY_REMOVED) {
+            idx = id;
+            break;
+          }
+        }
+        if (idx == UINT32_MAX) {
+          idx = copies.size();
+          copies.emplace_back();
+          extra.push_back(idx);
+          added.push_back(idx);
+        }
+      }
+
+      copies[idx] = Copy{&i, dest, bb, COPY_STORE};
+      copy_idx[&i] = idx;
+      next_id[group] = idx + 1;
+    }
+  }
+  return copies.size() <= capacity;
+}
+
+/*
+ * update brings the analysis up to date after the instructions of the blocks
+ * in modified have changed. Only the COPY and KILL sets of those blocks are
+ * recomputed, new ids are added to the KILL sets of the other blocks that
+ * store to their destinations, and the solver is rerun over the blocks
+ * reachable from the modified ones, whose other inputs are final. The result
+ * is the one a new analysis would compute, though the ids of the copies may
+ * differ from its ids.
+ *
+ * Every block whose instructions were added, removed or changed must be
+ * listed, including new blocks; no block may have been removed. If a listed
+ * block's successors have changed, the new copies do not fit in the sets,
+ * or the function has memory intrinsics, whose kills cross groups, the
+ * analysis is rebuilt from scratch instead.
+ */
+void DataFlowAnalysis::update(ArrayRef<BasicBlock *> modified) {
+  bool rebuild = mem_writes;
+  for (BasicBlock *bb : modified) {
+    for (Instruction &ins : *bb) {
+      rebuild |= isa<AnyMemIntrinsic>(ins);
+    }
+  }
+  if (rebuild) {
+    build();
+    return;
+  }
+
+  // counted on the first update, since most analyses are never updated
+  if (nr_succs.empty()) {
+    nr_succs.assign(rpo.size(), 0);
+    for (uint32_t p : preds) nr_succs[p]++;
+  }
+
+  vector<uint32_t> changed;
+  vector<bool> in_region(rpo.size());
+  for (BasicBlock *bb : modified) {
+    auto it = block_idx.find(bb);
+    // a new block, or an unreachable one, stays unreachable unless the
+    // successors of a reachable block changed
+    if (it == block_idx.end()) continue;
+    if (successorsChanged(bb, it->second)) {
+      build();
+      return;
+    }
+    if (!in_region[it->second]) {
+      in_region[it->second] = true;
+      changed.push_back(it->second);
+    }
+  }
+  SmallVector<uint32_t, 4> added;
+  if (!renumberStores(modified, added)) {
+    build();
+    return;
+  }
+  if (set_kind == SETS_ON_DEMAND) {
+    // any answer after a modified block may have changed
+    available.clear();
+    group_defs.clear();
+    for (BasicBlock *bb : modified) {
+      addStoredDests(*bb);
+    }
+    return;
+  }
+
+  // the other blocks that store to the destination of a new id kill it too.
+  // Only the new copy's block makes it, so it is in no CPIn outside the
+  // region and their CPOut only changes if they are in the region anyway.
+  vector<pair<uint32_t, uint32_t>> kills;
+  for (uint32_t idx : added) {
+    uint32_t group = dest_group[copies[idx].dest];
+    auto addKill = [&](uint32_t id) {
+      if (copies[id].kind != COPY_STORE ||
+          copies[id].block == copies[idx].block) {
+        return;
+      }
+      auto it = block_idx.find(copies[id].block);
+      // changed blocks have their KILL sets rebuilt
+      if (it != block_idx.end() && !in_region[it->second]) {
+        kills.push_back({it->second, idx});
+      }
+    };
+    for (uint32_t id = group_begin[group]; id < group_begin[group + 1]; id++) {
+      addKill(id);
+    }
+    for (uint32_t id : group_extra[group]) {
+      addKill(id);
+    }
+  }
+  std::sort(kills.begin(), kills.end());
+
+  // the blocks reachable from the changed ones
+  vector<uint32_t> region(changed);
+  for (uint32_t i = 0; i < region.size(); i++) {
+    for (BasicBlock *succ : successors(rpo[region[i]])) {
+      uint32_t s = block_idx.find(succ)->second;
+      if (!in_region[s]) {
+        in_region[s] = true;
+        region.push_back(s);
+      }
+    }
+  }
+  std::sort(region.begin(), region.end());
+
+  switch (set_kind) {
+    case SETS_FIXED_1:
+      resolve<FixedBitSet<1>>(changed, kills, region);
+      break;
+    case SETS_FIXED_4:
+      resolve<FixedBitSet<4>>(changed, kills, region);
+      break;
+    case SETS_SHARED:
+      resolve<SharedBitSet>(changed, kills, region);
+      break;
+    case SETS_ON_DEMAND:
+      // returned above: there are no sets, and the answers were dropped
+      break;
+  }
+}
+
+/*
+ * DataFlowAnalysis constructs the data flow analysis for the function F. If
+ * log is not null the copy indices and data-flow sets are printed to it, and
+ * the sets are always solved.
+ */
+DataFlowAnalysis::DataFlowAnalysis(Function &F, raw_ostream *log, Mode mode,
+                                   unsigned int threads)
+    : func(F), sets(nullptr), mode(log ? SETS : mode), threads(threads) {
+  build();
+
+  if (log) {
+    *log << "post DFA"
+         << "\n";
+    printCopyIdxs(*log);
+    printDFA(*log);
+  }
+}
+
+}  // namespace cpass
@@ -0,0 +1,499 @@
+#ifndef DATA_FLOW_H
+#define DATA_FLOW_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "cpass.h"
+#include "range_copies.h"
+
+namespace cpass {
+
+typedef uint64_t BitWord;
+static const unsigned int WORD_BITS = 64;
+
+/*
+ * BitSetOps provides the bit operations shared by the bit-set types the
+ * solver can be instantiated with. A bit-set type Impl derives from
+ * BitSetOps<Impl> and provides numWords() and data(). All sets of one
+ * analysis have the same size, and the bits past the end are always clear.
+ */
+template <class Impl>
+class BitSetOps {
+ public:
+  void clear() {
+    unsigned int nr_words = static_cast<Impl *>(this)->numWords();
+    memset(words(), 0, nr_words * sizeof(BitWord));
+  }
+  bool test(unsigned int i) const {
+    return (words()[i / WORD_BITS] >> (i % WORD_BITS)) & 1;
+  }
+  bool operator[](unsigned int i) const { return test(i); }
+  void set(unsigned int i) {
+    words()[i / WORD_BITS] |= BitWord(1) << (i % WORD_BITS);
+  }
+  void reset(unsigned int i) {
+    words()[i / WORD_BITS] &= ~(BitWord(1) << (i % WORD_BITS));
+  }
+  /* setRange sets bits [begin, end) */
+  void setRange(unsigned int begin, unsigned int end) {
+    for (; begin < end && begin % WORD_BITS; begin++) set(begin);
+    for (; begin + WORD_BITS <= end; begin += WORD_BITS) {
+      words()[begin / WORD_BITS] = ~BitWord(0);
+    }
+    for (; begin < end; begin++) set(begin);
+  }
+
+ private:
+  BitWord *words() { return static_cast<Impl *>(this)->data(); }
+  const BitWord *words() const {
+    return static_cast<const Impl *>(this)->data();
+  }
+};
+
+/*
+ * BitSet is a set of copy indices of any size. Its words are allocated from
+ * the arena of the analysis that owns it and are never freed individually,
+ * so a BitSet needs no destructor.
+ */
+class BitSet : public BitSetOps<BitSet> {
+ public:
+  BitSet(llvm::BumpPtrAllocator &arena, unsigned int size)
+      : nr_words((size + WORD_BITS - 1) / WORD_BITS) {
+    words = arena.Allocate<BitWord>(nr_words);
+    memset(words, 0, nr_words * sizeof(BitWord));
+  }
+  BitSet(const BitSet &) = delete;
+  BitSet &operator=(const BitSet &) = delete;
+
+  unsigned int numWords() const { return nr_words; }
+  BitWord *data() { return words; }
+  const BitWord *data() const { return words; }
+
+ private:
+  BitWord *words;
+  unsigned int nr_words;
+};
+
+/*
+ * FixedBitSet is a set of at most N * 64 copy indices, stored inline. The
+ * number of words is a constant, so the solver's loops over it are fully
+ * unrolled.
+ */
+template <unsigned int N>
+class FixedBitSet : public BitSetOps<FixedBitSet<N>> {
+ public:
+  FixedBitSet(llvm::BumpPtrAllocator &, unsigned int) { words.fill(0); }
+  FixedBitSet(const FixedBitSet &) = delete;
+  FixedBitSet &operator=(const FixedBitSet &) = delete;
+
+  static constexpr unsigned int numWords() { return N; }
+  BitWord *data() { return words.data(); }
+  const BitWord *data() const { return words.data(); }
+
+ private:
+  std::array<BitWord, N> words;
+};
+
+/*
+ * SetPool hash-conses the sets of one analysis: each distinct set is stored
+ * once, in the analysis' arena, and is never modified, so two sets are equal
+ * exactly when their words are at the same address. A set is changed by
+ * building the new contents elsewhere and interning them (copy on write).
+ */
+class SetPool {
+ public:
+  SetPool(llvm::BumpPtrAllocator &arena, unsigned int nr_words);
+  SetPool(const SetPool &) = delete;
+  SetPool &operator=(const SetPool &) = delete;
+
+  unsigned int numWords() const { return nr_words; }
+  const BitWord *empty() const { return empty_set; }
+  /* intern returns the pooled set equal to words, pooling a copy if needed */
+  const BitWord *intern(const BitWord *words);
+
+ private:
+  llvm::BumpPtrAllocator &arena;
+  unsigned int nr_words;
+  const BitWord *empty_set;
+  // pooled sets by hash
+  llvm::DenseMap<uint64_t, llvm::SmallVector<const BitWord *, 1>> buckets;
+};
+
+/*
+ * SharedBitSet is a set interned in a SetPool. It is only a pointer, so
+ * blocks with the same sets, such as the blocks of a straight-line chain,
+ * share them, and a block with a single predecessor takes that
+ * predecessor's CPOut without copying it.
+ */
+class SharedBitSet {
+ public:
+  const BitWord *words;
+
+  SharedBitSet(llvm::BumpPtrAllocator &, unsigned int) : words(nullptr) {}
+  const BitWord *data() const { return words; }
+};
+
+enum CopyKind : uint8_t {
+  // a function argument, which is a copy into the argument on entry
+  COPY_ARGUMENT,
+  // a store of a value to an address
+  COPY_STORE,
+  // a memset or memcpy (see isRangeCopy); its destination is itself
+  COPY_RANGE,
+  // the id of a store removed since the analysis was built; see update
+  COPY_REMOVED,
+};
+
+/*
+ * Copy is the entry for one copy in the analysis' copy table. For an
+ * argument, def and dest are the argument itself and block is null.
+ */
+struct Copy {
+  llvm::Value *def;
+  llvm::Value *dest;
+  llvm::BasicBlock *block;
+  CopyKind kind;
+
+  /*
+   * source returns the value currently copied, or for a range copy the
+   * memset or memcpy itself. It is read from the store each time, because
+   * propagation rewrites store operands and removes the loads they referred
+   * to while the analysis is in use.
+   */
+  llvm::Value *source() const {
+    return kind == COPY_STORE
+               ? llvm::cast<llvm::StoreInst>(def)->getValueOperand()
+               : def;
+  }
+};
+
+template <class Set>
+class BasicBlockInfo {
+ public:
+  Set COPY;
+  Set KILL;
+  Set CPIn;
+  Set CPOut;
+
+  BasicBlockInfo(llvm::BumpPtrAllocator &arena, unsigned int max_copies)
+      : COPY(arena, max_copies),
+        KILL(arena, max_copies),
+        CPIn(arena, max_copies),
+        CPOut(arena, max_copies) {}
+};
+
+/*
+ * solveForward solves a forward data-flow problem whose meet is
+ * intersection, such as available copies or available expressions: CPIn of
+ * a block is the intersection of the CPOut sets of its predecessors, and
+ * CPOut is COPY | (CPIn & ~KILL), where COPY is the set the block generates.
+ * The blocks are numbered in reverse post order, block 0 being the entry,
+ * and the predecessors of block b are preds[pred_begin[b]] up to
+ * preds[pred_begin[b + 1]]. The CPIn and CPOut sets must be empty.
+ *
+ * If region is not null only the blocks in it, in reverse post order, are
+ * solved, and no block outside it may be reachable from one inside it.
+ * Instantiated for FixedBitSet<1>, FixedBitSet<4> and BitSet.
+ */
+template <class Set>
+void solveForward(BasicBlockInfo<Set> *blocks, const uint32_t *pred_begin,
+                  const uint32_t *preds, uint32_t nr_blocks,
+                  const std::vector<uint32_t> *region = nullptr);
+
+enum Meet : uint8_t {
+  // some path: the least fixed point
+  MEET_UNION,
+  // all paths: the greatest fixed point that holds no more than MEET_UNION
+  MEET_INTERSECTION,
+};
+
+/*
+ * solveBackward solves a backward data-flow problem, such as live variables
+ * (MEET_UNION) or anticipated expressions (MEET_INTERSECTION): CPOut of a
+ * block is the meet of the CPIn sets of its successors, and CPIn is COPY |
+ * (CPOut & ~KILL), where COPY holds what the block uses before it defines
+ * it and KILL what it defines. CPOut of a block without successors is
+ * empty. Blocks are numbered as for solveForward, and the successors of
+ * block b are succs[succ_begin[b]] up to succs[succ_begin[b + 1]]. The CPIn
+ * and CPOut sets must be empty. Instantiated for the same types as
+ * solveForward.
+ */
+template <class Set>
+void solveBackward(BasicBlockInfo<Set> *blocks, const uint32_t *succ_begin,
+                   const uint32_t *succs, uint32_t nr_blocks,
+                   Meet meet = MEET_UNION);
+
+/*
+ * CFGNumbering numbers the blocks of a function reachable from its entry in
+ * reverse post order, as the solvers expect, and lists the reachable
+ * predecessors and the successors of each block by number. Passes other
+ * than DataFlowAnalysis use it to set up solveForward and solveBackward.
+ */
+struct CFGNumbering {
+  std::vector<llvm::BasicBlock *> rpo;
+  llvm::DenseMap<llvm::BasicBlock *, uint32_t> block_idx;
+  std::vector<uint32_t> pred_begin;
+  std::vector<uint32_t> preds;
+  std::vector<uint32_t> succ_begin;
+  std::vector<uint32_t> succs;
+
+  explicit CFGNumbering(llvm::Function &F);
+};
+
+/*
+ * BlockSets holds the solved sets of every reachable block, indexed by the
+ * block's position in reverse post order, whichever bit-set type they were
+ * solved with.
+ */
+class BlockSets {
+ public:
+  enum Kind { COPY, KILL, CP_IN, CP_OUT };
+  virtual const BitWord *getWords(unsigned int block, Kind kind) const = 0;
+
+ protected:
+  ~BlockSets() {}
+};
+
+/*
+ * SlicedSets holds the SharedBitSets of an analysis solved in slices (see
+ * DataFlowAnalysis): slice s of a set is slices[s][block]. getWords joins
+ * the slices of a set in a buffer that the next call reuses.
+ */
+class SlicedSets : public BlockSets {
+ public:
+  SlicedSets(BasicBlockInfo<SharedBitSet> *const *slices,
+             unsigned int nr_slices, unsigned int slice_words,
+             unsigned int nr_words, BitWord *joined)
+      : slices(slices),
+        nr_slices(nr_slices),
+        slice_words(slice_words),
+        nr_words(nr_words),
+        joined(joined) {}
+  const BitWord *getWords(unsigned int block, Kind kind) const override {
+    if (nr_slices == 1) return getSlice(0, block, kind);
+    for (unsigned int s = 0; s < nr_slices; s++) {
+      unsigned int begin = s * slice_words;
+      memcpy(joined + begin, getSlice(s, block, kind),
+             std::min(slice_words, nr_words - begin) * sizeof(BitWord));
+    }
+    return joined;
+  }
+
+ private:
+  BasicBlockInfo<SharedBitSet> *const *slices;
+  unsigned int nr_slices, slice_words, nr_words;
+  BitWord *joined;
+
+  const BitWord *getSlice(unsigned int s, unsigned int block,
+                          Kind kind) const {
+    const BasicBlockInfo<SharedBitSet> &bbi = slices[s][block];
+    switch (kind) {
+      case COPY:
+        return bbi.COPY.words;
+      case KILL:
+        return bbi.KILL.words;
+      case CP_IN:
+        return bbi.CPIn.words;
+      default:
+        return bbi.CPOut.words;
+    }
+  }
+};
+
+template <class Set>
+class BlockSetsImpl : public BlockSets {
+ public:
+  BasicBlockInfo<Set> *blocks;
+
+  BlockSetsImpl(BasicBlockInfo<Set> *blocks) : blocks(blocks) {}
+  const BitWord *getWords(unsigned int block, Kind kind) const override {
+    const BasicBlockInfo<Set> &bbi = blocks[block];
+    switch (kind) {
+      case COPY:
+        return bbi.COPY.data();
+      case KILL:
+        return bbi.KILL.data();
+      case CP_IN:
+        return bbi.CPIn.data();
+      default:
+        return bbi.CPOut.data();
+    }
+  }
+};
+
+/*
+ * DataFlowAnalysis computes the COPY, KILL, CPIn and CPOut sets of every
+ * block of a function, and from them the ACP table available on entry to
+ * each block, for global copy propagation.
+ *
+ * The solver is instantiated for a few bit-set types, and the one used is
+ * picked per function from the number of copies: functions with up to 64
+ * or 256 copies use FixedBitSets, larger ones SharedBitSets, whose words
+ * are too many to repeat in every block. The block infos and
+ * their sets are allocated from an arena owned by the analysis and released
+ * together with it.
+ *
+ * With more than one thread, the SharedBitSets are split into as many
+ * slices of words, which are solved in parallel.
+ *
+ * A large function with few loads is not solved: getACP instead finds the
+ * copy available for each address the block uses by walking back from the
+ * block, which touches far fewer blocks than the solver.
+ *
+ * memsets and memcpys are range copies: one is killed by a write to any of
+ * the bytes it wrote or, for a memcpy, read, and kills the stores to the
+ * bytes it writes, whatever their address. Functions with any are always
+ * solved, and rebuilt rather than updated.
+ *
+ * update brings an analysis up to date after edits to a few blocks, at a
+ * cost that grows with the part of the CFG the edits can reach rather than
+ * with the function. An analysis only touches its own
+ * function and holds no global state, so analyses of functions in different
+ * LLVMContexts can run concurrently.
+ */
+class DataFlowAnalysis {
+ public:
+  // whether to solve the sets or to find ACP tables on demand; AUTO picks
+  // on demand for large functions with few loads
+  enum Mode { AUTO, SETS, ON_DEMAND };
+
+ private:
+  /* LLVM does not store the position of instructions in the Instruction
+   * class, so every copy is given an id: its index in the copies table and
+   * its bit in the BitSet objects. copy_idx maps a copy back to its id.
+   *
+   * Copies to the same destination, which kill each other, have consecutive
+   * ids: dest_group maps a destination to its group, and the group's copies
+   * are ids group_begin[group] up to group_begin[group + 1].
+   */
+  std::vector<Copy> copies;
+  llvm::DenseMap<llvm::Value *, uint32_t> copy_idx;
+  llvm::DenseMap<llvm::Value *, uint32_t> dest_group;
+  std::vector<uint32_t> group_begin;
+  // copies given ids by update after the group's range was full
+  llvm::DenseMap<uint32_t, llvm::SmallVector<uint32_t, 2>> group_extra;
+  // the reachable blocks of the function in reverse post order, and the
+  // position of each in it
+  std::vector<llvm::BasicBlock *> rpo;
+  llvm::DenseMap<llvm::BasicBlock *, uint32_t> block_idx;
+  // the reachable predecessors of block b are preds[pred_begin[b]] up to
+  // preds[pred_begin[b + 1]]
+  std::vector<uint32_t> pred_begin;
+  std::vector<uint32_t> preds;
+  // the number of edges out of each reachable block to reachable blocks,
+  // for update
+  std::vector<uint32_t> nr_succs;
+  llvm::BumpPtrAllocator arena;
+  llvm::Function &func;
+  BlockSets *sets;
+  // the type of the sets, and the largest number of copies they can hold;
+  // with SETS_ON_DEMAND there are no sets, see availableCopy
+  enum SetKind {
+    SETS_FIXED_1,
+    SETS_FIXED_4,
+    SETS_SHARED,
+    SETS_ON_DEMAND
+  } set_kind;
+  unsigned int capacity;
+  Mode mode;
+  // the sets of a SETS_SHARED analysis, in slices of slice_words words:
+  // slice s holds the words from s * slice_words of every set, interned in
+  // pools[s] and allocated from slice_arenas[s - 1] (arena for slice 0), so
+  // that the slices can be solved on different threads; see solveSlices
+  std::vector<BasicBlockInfo<SharedBitSet> *> slices;
+  std::vector<std::unique_ptr<SetPool>> pools;
+  std::vector<std::unique_ptr<llvm::BumpPtrAllocator>> slice_arenas;
+  unsigned int slice_words;
+  // the number of slices, each solved on its own thread
+  unsigned int threads;
+  // the answers of availableCopy so far, by group and block, and the last
+  // copy of each block that stores to a queried group, by block
+  llvm::DenseMap<uint64_t, uint32_t> available;
+  llvm::DenseMap<uint32_t, llvm::SmallVector<std::pair<uint32_t, uint32_t>, 4>>
+      group_defs;
+  std::vector<uint32_t> visited;
+  uint32_t visit;
+  // the copy destinations that some store stores as a value; a superset
+  // after update
+  llvm::DenseSet<llvm::Value *> stored_dests;
+  // whether the function has memory intrinsics, and if so the groups of
+  // stores and range copies by the object of the bytes they write or, for
+  // a memcpy, read, with those bytes; see killOverlapping
+  bool mem_writes;
+  llvm::DenseMap<llvm::Value *,
+                 llvm::SmallVector<std::pair<uint32_t, Extent>, 2>>
+      object_groups;
+  std::vector<uint32_t> range_groups;
+
+  void build();
+  void initCopyIdxs(llvm::Function &F);
+  void initPreds();
+  bool successorsChanged(llvm::BasicBlock *bb, uint32_t b);
+  bool renumberStores(llvm::ArrayRef<llvm::BasicBlock *> modified,
+                      llvm::SmallVectorImpl<uint32_t> &added);
+  template <class Set>
+  void solve();
+  void initObjectGroups();
+  template <class Set>
+  bool addCOPYAndKILL(llvm::BasicBlock *bb, Set &COPY, Set &KILL);
+  template <class Set>
+  void killGroup(llvm::BasicBlock *bb, uint32_t group, Set &COPY, Set &KILL);
+  template <class Set>
+  void killOverlapping(llvm::BasicBlock *bb, const Extent &written,
+                       uint32_t self, bool stores, Set &COPY, Set &KILL);
+  template <class Set>
+  void initCOPYAndKILLSets(BasicBlockInfo<Set> *blocks);
+  template <class Set>
+  void initCPInAndCPOutSets(BasicBlockInfo<Set> *blocks,
+                            const std::vector<uint32_t> *region = nullptr);
+  void initSlicedCOPYAndKILLSets(const std::vector<uint32_t> *only = nullptr);
+  void initCPInAndCPOutSets(BasicBlockInfo<SharedBitSet> *blocks,
+                            SetPool &pool,
+                            const std::vector<uint32_t> *region = nullptr);
+  void solveSlices(const std::vector<uint32_t> *region = nullptr);
+  template <class Set>
+  void resolve(const std::vector<uint32_t> &modified,
+               const std::vector<std::pair<uint32_t, uint32_t>> &kills,
+               const std::vector<uint32_t> &region);
+  void initACP(unsigned int block, ACPTable &acp);
+  bool useOnDemand();
+  uint32_t availableCopy(uint32_t group, uint32_t block);
+  void initDemandedACP(llvm::BasicBlock &bb, uint32_t block, ACPTable &acp);
+  void addStoredDests(llvm::BasicBlock &bb);
+  std::vector<uint32_t> printOrder();
+
+ public:
+
+  DataFlowAnalysis(llvm::Function &F, llvm::raw_ostream *log = nullptr,
+                   Mode mode = AUTO, unsigned int threads = 1);
+  DataFlowAnalysis(const DataFlowAnalysis &) = delete;
+  DataFlowAnalysis &operator=(const DataFlowAnalysis &) = delete;
+
+  void update(llvm::ArrayRef<llvm::BasicBlock *> modified);
+  ACPTable getACP(llvm::BasicBlock &bb);
+  /* getRPO returns the reachable blocks of the function in reverse post
+   * order */
+  const std::vector<llvm::BasicBlock *> &getRPO() const { return rpo; }
+  void printCopyIdxs(llvm::raw_ostream &os);
+  void printDFA(llvm::raw_ostream &os);
+};  // end DataFlowAnalysis
+
+}  // namespace cpass
+
+#endif  // DATA_FLOW_H
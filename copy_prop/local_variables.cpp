@@ -0,0 +1,73 @@
+#include "llvm/IR/Instructions.h"
+
+#include "local_variables.h"
+
+using namespace llvm;
+using namespace std;
+
+namespace cpass {
+
+/*
+ * isLocalVariable returns true if nothing but simple loads and stores of
+ * its allocated type use alloca.
+ */
+static bool isLocalVariable(AllocaInst &alloca) {
+  if (alloca.isArrayAllocation()) return false;
+  Type *type = alloca.getAllocatedType();
+  for (Use &use : alloca.uses()) {
+    auto *load = dyn_cast<LoadInst>(use.getUser());
+    auto *store = dyn_cast<StoreInst>(use.getUser());
+    if (load && load->isSimple() && load->getType() == type) continue;
+    if (store && store->isSimple() && use.getOperandNo() == 1 &&
+        store->getValueOperand()->getType() == type) {
+      continue;
+    }
+    return false;
+  }
+  return true;
+}
+
+/*
+ * The LocalVariables constructor numbers the local variables among the
+ * allocas of the entry block of F, in order, and then, with escaping set,
+ * the other allocas that are not array allocations.
+ */
+LocalVariables::LocalVariables(Function &F, bool escaping) {
+  std::vector<AllocaInst *> others;
+  for (Instruction &ins : F.getEntryBlock()) {
+    auto *alloca = dyn_cast<AllocaInst>(&ins);
+    if (!alloca) continue;
+    if (isLocalVariable(*alloca)) {
+      number[alloca] = allocas.size();
+      allocas.push_back(alloca);
+    } else if (escaping && !alloca->isArrayAllocation()) {
+      others.push_back(alloca);
+    }
+  }
+  nr_local = allocas.size();
+  for (AllocaInst *alloca : others) {
+    number[alloca] = allocas.size();
+    allocas.push_back(alloca);
+  }
+}
+
+uint32_t LocalVariables::variableOf(Instruction &ins) const {
+  Value *ptr = nullptr;
+  Type *type = nullptr;
+  if (auto *load = dyn_cast<LoadInst>(&ins)) {
+    if (!load->isSimple()) return NONE;
+    ptr = load->getPointerOperand();
+    type = load->getType();
+  } else if (auto *store = dyn_cast<StoreInst>(&ins)) {
+    if (!store->isSimple()) return NONE;
+    ptr = store->getPointerOperand();
+    type = store->getValueOperand()->getType();
+  } else {
+    return NONE;
+  }
+  auto it = number.find(ptr);
+  if (it == number.end()) return NONE;
+  return allocas[it->second]->getAllocatedType() == type ? it->second : NONE;
+}
+
+}  // namespace cpass
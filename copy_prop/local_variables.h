@@ -0,0 +1,51 @@
+#ifndef LOCAL_VARIABLES_H
+#define LOCAL_VARIABLES_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+namespace cpass {
+
+/*
+ * LocalVariables numbers the allocas of a function that do not escape:
+ * every use is a simple load from the alloca or a simple store to it, of
+ * the allocated type. Nothing but those loads can read such a variable and
+ * it is dead once the function returns, so passes may move and remove its
+ * loads and stores without looking at other memory accesses.
+ *
+ * With escaping set, the other single allocas of the entry block are
+ * numbered as well, after those. Any instruction that may write memory may
+ * write one of them, but a load from it is still safe anywhere in the
+ * function.
+ */
+class LocalVariables {
+ public:
+  static const uint32_t NONE = UINT32_MAX;
+
+  explicit LocalVariables(llvm::Function &F, bool escaping = false);
+
+  unsigned int size() const { return allocas.size(); }
+  llvm::AllocaInst *get(uint32_t v) const { return allocas[v]; }
+  /* escapes returns true if variable v may be accessed other than directly */
+  bool escapes(uint32_t v) const { return v >= nr_local; }
+  /*
+   * variableOf returns the number of the variable ins loads from or stores
+   * to by a simple load or store of its type, or NONE if it accesses none.
+   */
+  uint32_t variableOf(llvm::Instruction &ins) const;
+
+ private:
+  std::vector<llvm::AllocaInst *> allocas;
+  llvm::DenseMap<llvm::Value *, uint32_t> number;
+  // the number of variables that do not escape
+  unsigned int nr_local = 0;
+};
+
+}  // namespace cpass
+
+#endif  // LOCAL_VARIABLES_H
@@ -0,0 +1,333 @@
+#include <vector>
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "cpass.h"
+#include "data_flow.h"
+#include "local_variables.h"
+#include "range_copies.h"
+#include "result_cache.h"
+
+using namespace llvm;
+using namespace std;
+
+namespace cpass {
+
+/*
+ * killOverlapping removes from acp the contents recorded for the addresses
+ * in written. The entries of the loads in forwarded, which hold the value
+ * loaded rather than what an address holds, are kept.
+ */
+static void killOverlapping(ACPTable &acp,
+                            const SmallPtrSetImpl<Value *> &forwarded,
+                            const Extent &written, const DataLayout &DL) {
+  for (auto it = acp.begin(); it != acp.end();) {
+    uint64_t size = storeSize(it->second->getType(), DL);
+    if (!forwarded.count(it->first) &&
+        written.overlaps(extentOf(it->first, size, DL))) {
+      it = acp.erase(it);
+    } else {
+      it++;
+    }
+  }
+}
+
+/*
+ * isUnescapedLocal returns true if ins is a simple store to a variable in
+ * locals that does not escape.
+ */
+static bool isUnescapedLocal(const LocalVariables &locals, Instruction &ins) {
+  uint32_t v = locals.variableOf(ins);
+  return v != LocalVariables::NONE && !locals.escapes(v);
+}
+
+/*
+ * propagateBlock performs copy propagation over the block bb using the
+ * available copy instructions in the table acp. It will also remove load
+ * instructions if they are no longer useful. acp is updated with the copies
+ * made in bb. Returns true if bb was modified.
+ *
+ * memsets and memcpys are copies over byte ranges, tracked in a RangeCopies:
+ * a load from bytes one of them wrote takes the value it left there. The
+ * ones available on entry are in acp as themselves.
+ *
+ * Useful tips:
+ *
+ * Use C++ features to iterate over the instructions in a block, e.g.:
+ *   Instruction *iptr;
+ *   for (Instruction &ins : bb) {
+ *     iptr = &ins;
+ *     ...
+ *   }
+ *
+ * You can use isa to determine the type of an instruction, e.g.:
+ *   if (isa<StoreInst>(iptr)) {
+ *     // iptr points to an Instruction that is a StoreInst
+ *   }
+ *
+ * Other useful LLVM routines:
+ *   int  Instruction::getOperand(int)
+ *   void Instruction::setOperand(int)
+ *   int  Instruction::getNumOperands()
+ *   void Instruction::eraseFromParent()
+ */
+bool propagateBlock(BasicBlock &bb, ACPTable &acp,
+                    vector<StoreInst *> *redundant_stores,
+                    const LocalVariables *locals) {
+  vector<Instruction *> to_remove;
+  // the loads in to_remove, whose entries in acp are the values they load
+  SmallPtrSet<Value *, 16> forwarded;
+  vector<StoreInst *> redundant;
+  bool changed = false;
+  Instruction *iptr;
+  Value *dest, *src;
+  unsigned int i;
+  const DataLayout &DL = bb.getModule()->getDataLayout();
+  RangeCopies ranges(DL);
+
+  for (auto it = acp.begin(); it != acp.end();) {
+    if (auto *mem = dyn_cast<MemIntrinsic>(it->first)) {
+      ranges.add(*mem);
+      it = acp.erase(it);
+    } else {
+      it++;
+    }
+  }
+
+  for (Instruction &ins : bb) {
+    iptr = &ins;
+
+    // found a store instruction
+    if (isa<StoreInst>(iptr)) {
+      dest = ins.getOperand(1);
+      src = ins.getOperand(0);
+
+      // a store of the value dest already holds changes nothing, so the acp
+      // stays as it is. Only a local variable that does not escape is known
+      // to still hold it: nothing else can write it. The store is rewritten
+      // like any other first, since its source may be a load about to be
+      // removed and the data-flow analysis may still read it
+      auto held = acp.find(dest);
+      auto copied = acp.find(src);
+      Value *value = copied != acp.end() ? copied->second : src;
+      if (held != acp.end() && held->second == value && locals &&
+          isUnescapedLocal(*locals, ins)) {
+        ins.setOperand(0, value);
+        redundant.push_back(cast<StoreInst>(iptr));
+        continue;
+      }
+
+      if (acp.find(dest) != acp.end()) {
+        // find all values in acp equal to dest and remove those
+        for (auto it = acp.begin(); it != acp.end();) {
+          if (it->second == dest) {
+            it = acp.erase(it);
+          } else {
+            it++;
+          }
+        }
+        // erase dest
+        acp.erase(dest);
+      }
+
+      if (acp.find(src) != acp.end()) {
+        ins.setOperand(0, acp[src]);
+        acp[dest] = acp[src];
+        changed = true;
+      } else {
+        acp[dest] = src;
+      }
+      if (!ranges.empty()) {
+        ranges.kill(writtenExtent(ins, DL));
+      }
+
+    } else if (isa<LoadInst>(iptr)) {
+      // found a load inst, associate the destination of
+      // the load with whats being stored and remove the instruction
+      dest = (Value *)iptr;
+      src = ins.getOperand(0);
+      // if the load instruction is pulling from something in the acp
+      if (acp.find(src) != acp.end()) {
+        acp[dest] = acp[src];
+        // add to list of instructions to remove
+        to_remove.push_back(iptr);
+        forwarded.insert(dest);
+      } else if (!ranges.empty() && cast<LoadInst>(iptr)->isSimple()) {
+        if (Value *value = ranges.forward(*cast<LoadInst>(iptr))) {
+          acp[dest] = value;
+          to_remove.push_back(iptr);
+          forwarded.insert(dest);
+        }
+      }
+    } else if (isa<AnyMemIntrinsic>(iptr)) {
+      // only its operands that are removed loads are replaced: an address
+      // in acp stands for what is stored there
+      for (i = 0; i < ins.getNumOperands(); i++) {
+        auto it = acp.find(ins.getOperand(i));
+        if (it != acp.end() && forwarded.count(it->first)) {
+          ins.setOperand(i, it->second);
+          changed = true;
+        }
+      }
+      Extent written = writtenExtent(ins, DL);
+      killOverlapping(acp, forwarded, written, DL);
+      ranges.kill(written);
+      if (isRangeCopy(ins, DL)) {
+        ranges.add(cast<MemIntrinsic>(ins));
+      }
+    } else {
+      // replace uses in acp when encountering any other instruction
+      for (i = 0; i < ins.getNumOperands(); i++) {
+        Value *op = ins.getOperand(i);
+        if (acp.find(op) != acp.end()) {
+          ins.setOperand(i, acp[op]);
+          changed = true;
+        }
+      }
+      // a call may write any of the bytes
+      if (ins.mayWriteToMemory()) {
+        ranges.clear();
+      }
+    }
+  }
+
+  // remove all the redundant stores and loads
+  if (redundant_stores) {
+    redundant_stores->insert(redundant_stores->end(), redundant.begin(),
+                             redundant.end());
+  } else {
+    for (StoreInst *store : redundant) {
+      store->eraseFromParent();
+    }
+  }
+  for (Instruction *ins : to_remove) {
+    ins->eraseFromParent();
+  }
+  return changed || !redundant.empty() || !to_remove.empty();
+}
+
+/*
+ * eraseRedundantStores removes the stores propagateBlock found redundant
+ * and counts them in the stats of opts.
+ */
+static void eraseRedundantStores(vector<StoreInst *> &stores,
+                                 const Options &opts) {
+  for (StoreInst *store : stores) {
+    store->eraseFromParent();
+  }
+  if (opts.stats) {
+    opts.stats->redundant_stores += stores.size();
+  }
+  stores.clear();
+}
+
+/*
+ * logStream returns the stream verbose output is written to.
+ */
+static raw_ostream &logStream(const Options &opts) {
+  return opts.log ? *opts.log : errs();
+}
+
+/*
+ * localCopyPropagation performs local copy propagation (LCP) over the basic
+ * blocks in the function F. The algorithm for LCP described on pp. 357-358 in
+ * the provided text (Muchnick).
+ *
+ * Useful tips:
+ *
+ * Use C++ features to iterate over the blocks in F, e.g.:
+ *   for (BasicBlock &bb : F) {
+ *     ...
+ *   }
+ *
+ * This routine should call propagateBlock
+ */
+bool localCopyPropagation(Function &F, const Options &opts) {
+  ACPTable acp;
+  vector<StoreInst *> redundant_stores;
+  LocalVariables locals(F);
+  bool changed = false;
+
+  for (BasicBlock &bb : F) {
+    changed |= propagateBlock(bb, acp, &redundant_stores, &locals);
+    // clear out acp between each run
+    acp.clear();
+  }
+  eraseRedundantStores(redundant_stores, opts);
+
+  // debug
+  if (opts.verbose) {
+    logStream(opts) << "post local"
+                    << "\n"
+                    << (*(&F)) << "\n";
+  }
+  return changed;
+}
+
+/*
+ * globalCopyPropagation performs global copy propagation (LCP) over the basic
+ * blocks in the function F. The algorithm for GCP described on pp. 358-360 in
+ * the provided text (Muchnick).
+ *
+ * Useful tips:
+ *
+ * This routine will use the DataFlowAnalysis to construct COPY, KILL, CPIn,
+ * and CPOut sets and an ACP table for each block.
+ *
+ * Use C++ features to iterate over the blocks in F, e.g.:
+ *   for (BasicBlock &bb : F) {
+ *     ...
+ *   }
+ *
+ * This routine should also call propagateBlock
+ */
+bool globalCopyPropagation(Function &F, const Options &opts) {
+  unsigned int threads =
+      F.size() >= PARALLEL_MIN_BLOCKS ? opts.solver_threads : 1;
+  DataFlowAnalysis dfa(F, opts.verbose ? &logStream(opts) : nullptr,
+                       DataFlowAnalysis::AUTO, threads);
+  ACPTable acp;
+  vector<StoreInst *> redundant_stores;
+  LocalVariables locals(F);
+  bool changed = false;
+
+  // visit blocks in reverse post order so that a copy available in a block
+  // has already had its source rewritten by the time the block is processed.
+  // The analysis reads the sources of copies from their stores, so redundant
+  // ones are only removed once every block has been processed
+  for (BasicBlock *bb : dfa.getRPO()) {
+    acp = dfa.getACP(*bb);
+    changed |= propagateBlock(*bb, acp, &redundant_stores, &locals);
+  }
+  eraseRedundantStores(redundant_stores, opts);
+
+  if (opts.verbose) {
+    logStream(opts) << "post global"
+                    << "\n"
+                    << (*(&F)) << "\n";
+  }
+  return changed;
+}
+
+/*
+ * propagate runs local copy propagation over F, followed by global copy
+ * propagation unless it is disabled in opts. With a cache in opts, the result
+ * is looked up there first.
+ */
+bool propagate(Function &F, const Options &opts) {
+  if (opts.cache) {
+    return opts.cache->propagate(F, opts);
+  }
+  bool changed = localCopyPropagation(F, opts);
+  if (opts.global) {
+    changed |= globalCopyPropagation(F, opts);
+  }
+  return changed;
+}
+
+}  // namespace cpass
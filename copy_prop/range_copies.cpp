@@ -0,0 +1,194 @@
+#include <algorithm>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Operator.h"
+
+#include "range_copies.h"
+
+using namespace llvm;
+using namespace std;
+
+namespace cpass {
+
+uint64_t storeSize(Type *type, const DataLayout &DL) {
+  TypeSize size = DL.getTypeStoreSize(type);
+  return size.isScalable() ? UINT64_MAX : size.getFixedSize();
+}
+
+Extent extentOf(Value *ptr, uint64_t size, const DataLayout &DL) {
+  APInt offset(DL.getIndexTypeSizeInBits(ptr->getType()), 0);
+  Value *object = ptr->stripAndAccumulateConstantOffsets(DL, offset, true);
+  bool known = !offset.isNegative() && offset.getActiveBits() <= 63;
+  // a GEP by a variable index may reach anywhere in the object
+  while (auto *gep = dyn_cast<GEPOperator>(object)) {
+    known = false;
+    object = gep->getPointerOperand()->stripPointerCasts();
+  }
+  uint64_t begin = known ? offset.getZExtValue() : 0;
+  if (!known || size >= UINT64_MAX - begin) {
+    return Extent{object, 0, UINT64_MAX};
+  }
+  return Extent{object, begin, begin + size};
+}
+
+Extent writtenExtent(Instruction &ins, const DataLayout &DL) {
+  if (auto *store = dyn_cast<StoreInst>(&ins)) {
+    return extentOf(store->getPointerOperand(),
+                    storeSize(store->getValueOperand()->getType(), DL), DL);
+  }
+  if (auto *mem = dyn_cast<AnyMemIntrinsic>(&ins)) {
+    auto *length = dyn_cast<ConstantInt>(mem->getLength());
+    return extentOf(mem->getRawDest(),
+                    length ? length->getZExtValue() : UINT64_MAX, DL);
+  }
+  return Extent{nullptr, 0, 0};
+}
+
+bool isRangeCopy(Instruction &ins, const DataLayout &DL) {
+  if (!isa<MemSetInst>(ins) && !isa<MemCpyInst>(ins)) return false;
+  MemIntrinsic &mem = cast<MemIntrinsic>(ins);
+  return !mem.isVolatile() && isa<ConstantInt>(mem.getLength()) &&
+         writtenExtent(ins, DL).known();
+}
+
+void RangeCopies::add(MemIntrinsic &mem) {
+  Extent dest = writtenExtent(mem, DL);
+  Extent source{nullptr, 0, 0};
+  if (auto *cpy = dyn_cast<MemCpyInst>(&mem)) {
+    source = extentOf(cpy->getRawSource(), dest.end - dest.begin, DL);
+  }
+  pieces.push_back(Piece{&mem, dest, source, dest.begin, dest.end});
+}
+
+void RangeCopies::kill(const Extent &written) {
+  std::vector<Piece> left;
+  bool changed = false;
+  for (Piece &piece : pieces) {
+    // the bytes of the piece overwritten, directly or through the source
+    // they were copied from, as up to two ranges of destination offsets
+    uint64_t cut[2][2];
+    unsigned int nr_cuts = 0;
+    Extent bytes{piece.dest.object, piece.begin, piece.end};
+    if (bytes.overlaps(written)) {
+      cut[nr_cuts][0] = std::max(written.begin, piece.begin);
+      cut[nr_cuts++][1] = std::min(written.end, piece.end);
+    }
+    if (piece.source.object == written.object) {
+      uint64_t from = piece.source.begin - piece.dest.begin;
+      Extent read{piece.source.object, piece.begin + from, piece.end + from};
+      if (!piece.source.known()) {
+        cut[nr_cuts][0] = piece.begin;
+        cut[nr_cuts++][1] = piece.end;
+      } else if (read.overlaps(written)) {
+        cut[nr_cuts][0] = std::max(written.begin, read.begin) - from;
+        cut[nr_cuts++][1] = std::min(written.end, read.end) - from;
+      }
+    }
+    if (!nr_cuts) {
+      left.push_back(piece);
+      continue;
+    }
+    changed = true;
+
+    // what is left of the piece around the cuts, in order
+    if (nr_cuts == 2 && cut[1][0] < cut[0][0]) {
+      std::swap(cut[0], cut[1]);
+    }
+    uint64_t begin = piece.begin;
+    for (unsigned int c = 0; c < nr_cuts; c++) {
+      if (cut[c][0] > begin) {
+        left.push_back(piece);
+        left.back().begin = begin;
+        left.back().end = cut[c][0];
+      }
+      begin = std::max(begin, cut[c][1]);
+    }
+    if (begin < piece.end) {
+      left.push_back(piece);
+      left.back().begin = begin;
+    }
+  }
+  if (changed) {
+    pieces.swap(left);
+  }
+}
+
+/*
+ * find returns the piece that covers all of want, or null. The pieces of
+ * an object never overlap, since a write cuts the earlier pieces it
+ * overlaps.
+ */
+const RangeCopies::Piece *RangeCopies::find(const Extent &want) const {
+  for (const Piece &piece : pieces) {
+    if (Extent{piece.dest.object, piece.begin, piece.end}.covers(want)) {
+      return &piece;
+    }
+  }
+  return nullptr;
+}
+
+/*
+ * memsetValue returns the value of type that set leaves in memory, or null
+ * if it is not a constant.
+ */
+Value *RangeCopies::memsetValue(MemSetInst &set, Type *type) {
+  Value *byte = set.getValue();
+  if (byte->getType() == type) return byte;
+  auto *value = dyn_cast<ConstantInt>(byte);
+  Type *scalar = type->getScalarType();
+  if (!value) return nullptr;
+  if (value->isZero() && (scalar->isIntegerTy() ||
+                          scalar->isFloatingPointTy() ||
+                          scalar->isPointerTy())) {
+    return Constant::getNullValue(type);
+  }
+  if (!type->isIntegerTy() && !type->isFloatingPointTy()) return nullptr;
+  uint64_t bits = DL.getTypeSizeInBits(type).getFixedSize();
+  if (bits % 8) return nullptr;
+  Constant *splat = ConstantInt::get(type->getContext(),
+                                     APInt::getSplat(bits, value->getValue()));
+  return ConstantExpr::getBitCast(splat, type);
+}
+
+Value *RangeCopies::forward(LoadInst &load) {
+  Type *type = load.getType();
+  uint64_t size = storeSize(type, DL);
+  Extent want = extentOf(load.getPointerOperand(), size, DL);
+  MemCpyInst *from = nullptr;
+  uint64_t offset = 0;
+
+  // follow memcpys back to where the bytes were first written. The pieces
+  // that cover the source of a memcpy were written before it, so this ends;
+  // the bound is for a memcpy of an object onto itself
+  for (size_t step = 0; step <= pieces.size() && want.known(); step++) {
+    const Piece *piece = find(want);
+    if (!piece) break;
+    uint64_t at = want.begin - piece->dest.begin;
+    if (auto *set = dyn_cast<MemSetInst>(piece->mem)) {
+      if (Value *value = memsetValue(*set, type)) return value;
+      break;
+    }
+    from = cast<MemCpyInst>(piece->mem);
+    offset = at;
+    want = piece->source;
+    if (want.known()) {
+      want.begin += at;
+      want.end = want.begin + size;
+    }
+  }
+  if (!from) return nullptr;
+
+  IRBuilder<> builder(&load);
+  Value *ptr = from->getRawSource();
+  if (offset) {
+    ptr = builder.CreateConstInBoundsGEP1_64(builder.getInt8Ty(), ptr, offset);
+  }
+  ptr = builder.CreatePointerCast(
+      ptr, type->getPointerTo(ptr->getType()->getPointerAddressSpace()));
+  return builder.CreateAlignedLoad(
+      type, ptr, commonAlignment(from->getSourceAlign().valueOrOne(), offset),
+      load.getName());
+}
+
+}  // namespace cpass
@@ -0,0 +1,105 @@
+#ifndef RANGE_COPIES_H
+#define RANGE_COPIES_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+
+namespace cpass {
+
+/*
+ * Extent is the bytes [begin, end) of an object that an access reaches. The
+ * object is what the address is computed from by casts and GEPs; as for
+ * stores, addresses in different objects are taken not to overlap. An
+ * access at an offset that is not constant, or of a size that is not,
+ * reaches the whole object.
+ */
+struct Extent {
+  llvm::Value *object;
+  uint64_t begin;
+  uint64_t end;
+
+  bool known() const { return end != UINT64_MAX; }
+  bool overlaps(const Extent &other) const {
+    return object == other.object && begin < other.end && other.begin < end;
+  }
+  bool covers(const Extent &other) const {
+    return object == other.object && begin <= other.begin &&
+           other.end <= end;
+  }
+};
+
+/*
+ * storeSize returns the number of bytes a load or store of type reaches, or
+ * UINT64_MAX if that is not a constant.
+ */
+uint64_t storeSize(llvm::Type *type, const llvm::DataLayout &DL);
+
+/* extentOf returns the extent of size bytes at ptr */
+Extent extentOf(llvm::Value *ptr, uint64_t size, const llvm::DataLayout &DL);
+
+/*
+ * writtenExtent returns the extent a store or memory intrinsic writes. The
+ * object is null for any other instruction.
+ */
+Extent writtenExtent(llvm::Instruction &ins, const llvm::DataLayout &DL);
+
+/*
+ * isRangeCopy returns true if ins is a memset or memcpy that copy
+ * propagation can forward loads from: not volatile, of a constant length,
+ * to a destination at a known offset.
+ */
+bool isRangeCopy(llvm::Instruction &ins, const llvm::DataLayout &DL);
+
+/*
+ * RangeCopies holds the memsets and memcpys that are available at a point
+ * in a block, and which of the bytes they wrote still hold what they wrote.
+ * A write to some of those bytes, or for a memcpy to the bytes of its
+ * source they were copied from, leaves the others available.
+ */
+class RangeCopies {
+ public:
+  explicit RangeCopies(const llvm::DataLayout &DL) : DL(DL) {}
+
+  bool empty() const { return pieces.empty(); }
+  void clear() { pieces.clear(); }
+  /* add makes the bytes written by mem, a range copy, available */
+  void add(llvm::MemIntrinsic &mem);
+  /* kill removes the bytes of written from the copies available */
+  void kill(const Extent &written);
+  /*
+   * forward returns the value load reads if the available copies tell:
+   * a constant for a memset, and for a memcpy the value the source is
+   * known to hold, or else a new load from the source inserted before
+   * load. Returns null if they do not.
+   */
+  llvm::Value *forward(llvm::LoadInst &load);
+
+ private:
+  /*
+   * Piece is the bytes [begin, end) of the destination of mem that still
+   * hold what it wrote. dest and source are the extents mem wrote and, for
+   * a memcpy, read.
+   */
+  struct Piece {
+    llvm::MemIntrinsic *mem;
+    Extent dest;
+    Extent source;
+    uint64_t begin;
+    uint64_t end;
+  };
+
+  const llvm::DataLayout &DL;
+  std::vector<Piece> pieces;
+
+  const Piece *find(const Extent &want) const;
+  llvm::Value *memsetValue(llvm::MemSetInst &set, llvm::Type *type);
+};
+
+}  // namespace cpass
+
+#endif  // RANGE_COPIES_H
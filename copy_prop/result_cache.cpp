@@ -0,0 +1,427 @@
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ValueHandle.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "cpass.h"
+#include "result_cache.h"
+
+using namespace llvm;
+using namespace std;
+
+namespace cpass {
+
+// first line of every entry; bump it when the format or the pass changes
+static const char ENTRY_VERSION[] = "cpass-cache 5";
+static const char ENTRY_SUFFIX[] = ".cpc";
+
+/*
+ * FunctionNumbering gives every argument, block and instruction of a function
+ * its position, so that values can be named in a form that is the same for
+ * every structurally identical copy of the function.
+ */
+struct FunctionNumbering {
+  vector<Instruction *> insts;
+  map<Value *, string> refs;
+
+  FunctionNumbering(Function &F) {
+    unsigned i = 0;
+    for (Argument &arg : F.args()) {
+      refs[&arg] = "a" + utostr(i++);
+    }
+    i = 0;
+    for (BasicBlock &bb : F) {
+      refs[&bb] = "b" + utostr(i++);
+    }
+    for (BasicBlock &bb : F) {
+      for (Instruction &ins : bb) {
+        refs[&ins] = "i" + utostr(insts.size());
+        insts.push_back(&ins);
+      }
+    }
+  }
+
+  /*
+   * operandRef names the value used as operand op of instruction i. Values
+   * that are not part of the function (constants, globals) are named by
+   * where they are first used, which is enough to find them again.
+   */
+  string operandRef(unsigned i, unsigned op) {
+    Value *v = insts[i]->getOperand(op);
+    auto it = refs.find(v);
+    if (it != refs.end()) return it->second;
+    string ref = "o" + utostr(i) + "." + utostr(op);
+    refs[v] = ref;
+    return ref;
+  }
+};
+
+/* scopeName names a sync scope, since ids depend on the context */
+static string scopeName(Instruction *ins, SyncScope::ID id) {
+  SmallVector<StringRef, 8> names;
+  ins->getContext().getSyncScopeNames(names);
+  return id < names.size() ? names[id].str() : utostr(id);
+}
+
+/*
+ * printMemoryBits prints what decides how the pass may treat a memory access
+ * beyond its operands: whether it is volatile, and its atomic ordering and
+ * sync scope; and for a call, whether it may read or write memory, which
+ * follows from the attributes of the call site and the callee.
+ */
+static void printMemoryBits(Instruction *ins, raw_ostream &os) {
+  if (isa<CallBase>(ins)) {
+    os << " reads=" << ins->mayReadFromMemory()
+       << " writes=" << ins->mayWriteToMemory();
+  }
+  if (auto *load = dyn_cast<LoadInst>(ins)) {
+    os << " volatile=" << load->isVolatile()
+       << " ordering=" << toIRString(load->getOrdering())
+       << " scope=" << scopeName(load, load->getSyncScopeID());
+  } else if (auto *store = dyn_cast<StoreInst>(ins)) {
+    os << " volatile=" << store->isVolatile()
+       << " ordering=" << toIRString(store->getOrdering())
+       << " scope=" << scopeName(store, store->getSyncScopeID());
+  } else if (auto *rmw = dyn_cast<AtomicRMWInst>(ins)) {
+    os << " volatile=" << rmw->isVolatile()
+       << " op=" << AtomicRMWInst::getOperationName(rmw->getOperation())
+       << " ordering=" << toIRString(rmw->getOrdering())
+       << " scope=" << scopeName(rmw, rmw->getSyncScopeID());
+  } else if (auto *cmpxchg = dyn_cast<AtomicCmpXchgInst>(ins)) {
+    os << " volatile=" << cmpxchg->isVolatile()
+       << " weak=" << cmpxchg->isWeak()
+       << " ordering=" << toIRString(cmpxchg->getSuccessOrdering()) << ","
+       << toIRString(cmpxchg->getFailureOrdering())
+       << " scope=" << scopeName(cmpxchg, cmpxchg->getSyncScopeID());
+  } else if (auto *fence = dyn_cast<FenceInst>(ins)) {
+    os << " ordering=" << toIRString(fence->getOrdering())
+       << " scope=" << scopeName(fence, fence->getSyncScopeID());
+  } else if (auto *mem = dyn_cast<MemIntrinsic>(ins)) {
+    os << " volatile=" << mem->isVolatile();
+  }
+}
+
+/*
+ * hashFunction computes the cache key of F under opts. Values are hashed by
+ * what they refer to, so names and the order of allocation do not matter.
+ * The data layout and target are part of the key, since the offsets and
+ * sizes of memory accesses depend on them.
+ */
+static string hashFunction(Function &F, const Options &opts) {
+  FunctionNumbering num(F);
+  string s;
+  raw_string_ostream os(s);
+
+  os << ENTRY_VERSION << " global=" << opts.global << "\n";
+  os << F.getParent()->getDataLayoutStr() << "\n";
+  os << F.getParent()->getTargetTriple() << "\n";
+  F.getFunctionType()->print(os);
+  os << "\n";
+  for (unsigned i = 0; i < num.insts.size(); i++) {
+    Instruction *ins = num.insts[i];
+    os << num.refs[ins->getParent()] << " " << ins->getOpcodeName() << " ";
+    ins->getType()->print(os);
+    printMemoryBits(ins, os);
+    for (unsigned op = 0; op < ins->getNumOperands(); op++) {
+      string ref = num.operandRef(i, op);
+      if (ref[0] == 'o') {
+        // constants are compared by value
+        os << " ";
+        ins->getOperand(op)->printAsOperand(os, true);
+      } else {
+        os << " " << ref;
+      }
+    }
+    os << "\n";
+  }
+
+  MD5 md5;
+  MD5::MD5Result result;
+  md5.update(os.str());
+  md5.final(result);
+  return string(result.digest().str());
+}
+
+/*
+ * resolveRef finds the value named by ref in a function numbered by num,
+ * before any edits are replayed. Returns null if ref is not valid.
+ */
+static Value *resolveRef(FunctionNumbering &num, Function &F, StringRef ref) {
+  unsigned i, op;
+  if (ref.empty()) return nullptr;
+  char kind = ref[0];
+  ref = ref.drop_front();
+
+  if (kind == 'a') {
+    if (ref.getAsInteger(10, i) || i >= F.arg_size()) return nullptr;
+    return F.getArg(i);
+  } else if (kind == 'i') {
+    if (ref.getAsInteger(10, i) || i >= num.insts.size()) return nullptr;
+    return num.insts[i];
+  } else if (kind == 'o') {
+    pair<StringRef, StringRef> parts = ref.split('.');
+    if (parts.first.getAsInteger(10, i) || i >= num.insts.size() ||
+        parts.second.getAsInteger(10, op) ||
+        op >= num.insts[i]->getNumOperands()) {
+      return nullptr;
+    }
+    return num.insts[i]->getOperand(op);
+  }
+  return nullptr;
+}
+
+ResultCache::ResultCache(const string &dir, uint64_t max_bytes)
+    : dir(dir), max_bytes(max_bytes), bytes_written(0) {
+  sys::fs::create_directories(dir);
+  prune();
+}
+
+string ResultCache::entryPath(const string &key) {
+  SmallString<128> path(dir);
+  sys::path::append(path, key + ENTRY_SUFFIX);
+  return string(path.str());
+}
+
+/*
+ * replay applies the edits in the cache entry contents to F. Nothing is
+ * changed unless the whole entry is valid. Returns false if it is not.
+ * Removed stores are counted in the stats of opts.
+ */
+static bool replay(Function &F, StringRef contents, const Options &opts,
+                   bool &changed) {
+  SmallVector<StringRef, 16> lines;
+  contents.split(lines, '\n', -1, false);
+  if (lines.size() < 2 || lines[0] != ENTRY_VERSION) return false;
+  if (lines[1] != "changed 0" && lines[1] != "changed 1") return false;
+  changed = lines[1] == "changed 1";
+
+  FunctionNumbering num(F);
+  vector<pair<Use *, Value *>> replacements;
+  vector<Instruction *> removed;
+  for (unsigned l = 2; l < lines.size(); l++) {
+    SmallVector<StringRef, 4> fields;
+    unsigned i, op;
+    lines[l].split(fields, ' ');
+    if (fields.size() < 2 || fields[1].getAsInteger(10, i) ||
+        i >= num.insts.size()) {
+      return false;
+    }
+    if (fields[0] == "r" && fields.size() == 4) {
+      Value *v = resolveRef(num, F, fields[3]);
+      if (fields[2].getAsInteger(10, op) ||
+          op >= num.insts[i]->getNumOperands() || !v) {
+        return false;
+      }
+      replacements.push_back({&num.insts[i]->getOperandUse(op), v});
+    } else if (fields[0] == "d" && fields.size() == 2) {
+      removed.push_back(num.insts[i]);
+    } else {
+      return false;
+    }
+  }
+
+  for (auto &r : replacements) {
+    r.first->set(r.second);
+  }
+  unsigned nr_stores = 0;
+  for (Instruction *ins : removed) {
+    nr_stores += isa<StoreInst>(ins);
+    ins->eraseFromParent();
+  }
+  if (opts.stats) {
+    opts.stats->redundant_stores += nr_stores;
+  }
+  return true;
+}
+
+/*
+ * record runs the pass over F and returns the cache entry describing what
+ * it did, or an empty string if the edits cannot be expressed as an entry:
+ * an entry only removes instructions, so a run that inserted any, such as a
+ * load forwarded from a memcpy, is not recorded.
+ */
+static string record(Function &F, const Options &opts, bool &changed) {
+  FunctionNumbering num(F);
+  vector<vector<Value *>> operands(num.insts.size());
+  for (unsigned i = 0; i < num.insts.size(); i++) {
+    for (unsigned op = 0; op < num.insts[i]->getNumOperands(); op++) {
+      operands[i].push_back(num.insts[i]->getOperand(op));
+      num.operandRef(i, op);
+    }
+  }
+
+  // handles, since an inserted instruction may take the address of a
+  // removed one
+  vector<WeakVH> remaining(num.insts.begin(), num.insts.end());
+  changed = propagate(F, opts);
+
+  size_t nr_insts = 0, nr_remaining = 0;
+  for (BasicBlock &bb : F) {
+    nr_insts += bb.size();
+  }
+  for (WeakVH &ins : remaining) {
+    nr_remaining += ins != nullptr;
+  }
+  if (nr_insts != nr_remaining) return "";
+
+  string s;
+  raw_string_ostream os(s);
+  os << ENTRY_VERSION << "\nchanged " << changed << "\n";
+  for (unsigned i = 0; i < num.insts.size(); i++) {
+    if (!remaining[i]) continue;
+    for (unsigned op = 0; op < operands[i].size(); op++) {
+      Value *v = num.insts[i]->getOperand(op);
+      if (v == operands[i][op]) continue;
+      auto it = num.refs.find(v);
+      if (it == num.refs.end()) return "";
+      os << "r " << i << " " << op << " " << it->second << "\n";
+    }
+  }
+  for (unsigned i = 0; i < num.insts.size(); i++) {
+    if (!remaining[i]) {
+      os << "d " << i << "\n";
+    }
+  }
+  return os.str();
+}
+
+/*
+ * propagate looks F up in the cache and replays the entry on a hit. On a
+ * miss it runs the pass, recording its edits, and stores them. Verbose runs
+ * bypass the cache, since a replay prints nothing.
+ */
+bool ResultCache::propagate(Function &F, const Options &opts) {
+  Options uncached = opts;
+  uncached.cache = nullptr;
+  if (opts.verbose) {
+    return cpass::propagate(F, uncached);
+  }
+
+  string path = entryPath(hashFunction(F, opts));
+  bool changed = false;
+  int fd;
+  bool hit = false;
+  if (!sys::fs::openFileForRead(path, fd)) {
+    ErrorOr<unique_ptr<MemoryBuffer>> buf =
+        MemoryBuffer::getOpenFile(fd, path, -1);
+    if (buf && replay(F, (*buf)->getBuffer(), opts, changed)) {
+      hit = true;
+      // the modification time orders entries for eviction
+      sys::fs::setLastAccessAndModificationTime(
+          fd, chrono::time_point_cast<chrono::nanoseconds>(
+                  chrono::system_clock::now()));
+    }
+    sys::fs::closeFile(fd);
+  }
+
+  {
+    lock_guard<mutex> guard(stats_lock);
+    stats.lookups++;
+    stats.hits += hit;
+  }
+  if (hit) return changed;
+
+  string entry = record(F, uncached, changed);
+  if (entry.empty()) return changed;
+
+  SmallString<128> tmp;
+  if (sys::fs::createUniqueFile(dir + "/tmp-%%%%%%%%", fd, tmp)) {
+    return changed;
+  }
+  {
+    raw_fd_ostream os(fd, true);
+    os << entry;
+    os.close();
+    if (os.has_error()) {
+      os.clear_error();
+      sys::fs::remove(tmp);
+      return changed;
+    }
+  }
+  if (sys::fs::rename(tmp, path)) {
+    sys::fs::remove(tmp);
+    return changed;
+  }
+
+  bool full;
+  {
+    lock_guard<mutex> guard(stats_lock);
+    stats.stores++;
+    bytes_written += entry.size();
+    full = bytes_written > max_bytes / 4;
+    if (full) bytes_written = 0;
+  }
+  if (full) prune();
+  return changed;
+}
+
+void ResultCache::prune() {
+  struct Entry {
+    string path;
+    uint64_t size;
+    sys::TimePoint<> mtime;
+  };
+  vector<Entry> entries;
+  uint64_t total = 0;
+  error_code ec;
+
+  for (sys::fs::directory_iterator it(dir, ec), end; it != end && !ec;
+       it.increment(ec)) {
+    if (!StringRef(it->path()).endswith(ENTRY_SUFFIX)) continue;
+    ErrorOr<sys::fs::basic_file_status> st = it->status();
+    if (!st) continue;
+    entries.push_back(
+        {it->path(), st->getSize(), st->getLastModificationTime()});
+    total += st->getSize();
+  }
+
+  // oldest first
+  std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+    return a.mtime < b.mtime;
+  });
+  unsigned evicted = 0;
+  for (const Entry &e : entries) {
+    if (total <= max_bytes) break;
+    if (!sys::fs::remove(e.path)) {
+      evicted++;
+    }
+    total -= e.size;
+  }
+
+  lock_guard<mutex> guard(stats_lock);
+  stats.evictions += evicted;
+  stats.bytes = total;
+}
+
+CacheStats ResultCache::getStats() {
+  lock_guard<mutex> guard(stats_lock);
+  return stats;
+}
+
+void ResultCache::printStats(raw_ostream &os) {
+  CacheStats s = getStats();
+  os << "cpass cache: " << s.lookups << " lookups, " << s.hits << " hits";
+  if (s.lookups) {
+    os << format(" (%.1f%%)", 100.0 * s.hits / s.lookups);
+  }
+  os << ", " << s.stores << " stores, " << s.evictions << " evictions, "
+     << s.bytes << " bytes\n";
+}
+
+}  // namespace cpass
@@ -0,0 +1,77 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+
+#include "llvm/IR/Function.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "cpass.h"
+
+namespace cpass {
+
+struct CacheStats {
+  unsigned lookups = 0;
+  unsigned hits = 0;
+  // results written to the cache
+  unsigned stores = 0;
+  // entries removed to keep the cache under its size limit
+  unsigned evictions = 0;
+  // size of the cache after the last prune
+  uint64_t bytes = 0;
+};
+
+/*
+ * ResultCache is an on-disk cache of copy propagation results, one file per
+ * function. Set Options::cache to use it from propagate.
+ *
+ * Entries are keyed by a structural hash of the function and of the
+ * options. The hash covers the CFG, the opcode and type of every
+ * instruction, what each operand refers to, the volatility and ordering of
+ * memory accesses, whether each call may read or write memory, and the data
+ * layout and target. It leaves out value names, metadata and other attributes, which
+ * the pass ignores. An entry records the edits the pass made, as operand
+ * replacements and removed loads and stores, so a hit replays them without
+ * running either phase; an empty entry means the pass is known not to change
+ * the function. Verbose runs bypass the cache, since a replay prints nothing.
+ *
+ * When the cache is opened, and once more than a quarter of max_bytes has
+ * been written since the last prune, the least recently used entries are
+ * removed until the directory is under max_bytes. A ResultCache may be
+ * shared by threads; entries are written to a temporary file and renamed,
+ * so several processes may also share a directory.
+ */
+class ResultCache {
+ private:
+  std::string dir;
+  uint64_t max_bytes;
+  uint64_t bytes_written;
+  CacheStats stats;
+  std::mutex stats_lock;
+
+  std::string entryPath(const std::string &key);
+
+ public:
+  ResultCache(const std::string &dir, uint64_t max_bytes);
+  ResultCache(const ResultCache &) = delete;
+  ResultCache &operator=(const ResultCache &) = delete;
+
+  /*
+   * propagate has the same effect as cpass::propagate without a cache, but
+   * replays the cached result for F if there is one and stores it if not.
+   */
+  bool propagate(llvm::Function &F, const Options &opts);
+
+  /* prune evicts least recently used entries until the cache fits */
+  void prune();
+
+  CacheStats getStats();
+  void printStats(llvm::raw_ostream &os);
+};
+
+}  // namespace cpass
+
+#endif  // RESULT_CACHE_H
@@ -0,0 +1,481 @@
+#!/usr/bin/env python3
+"""
+Differential execution fuzzer for the copy_prop pass.
+
+Generates random programs as LLVM IR in the style of clang -O0 output (every
+variable lives in an alloca and is loaded/stored around each use), runs each
+one under lli before and after copy_prop, and compares the observable
+behaviour: stdout and the exit code. When a reference plugin is given, its
+output is compared as well.
+
+Programs are built from a small statement tree (assignments, if/else,
+bounded loops, prints) that only uses well-defined operations, so every
+difference is a miscompile. Failing programs are minimized automatically by
+delta debugging over that tree and written to the output directory together
+with the original.
+
+usage:
+  fuzz/difffuzz.py [--runs N] [--jobs J] [--seed S]
+                   [--plugin build/copy_prop/libcopy_prop.so]
+                   [--ref ref_builds/lib_ref_copy_prop.so]
+                   [--escapes] [--out fuzz/failures]
+
+  --escapes also passes the address of variables to an opaque function that
+  modifies them, which the pass does not model today.
+"""
+
+import argparse
+import multiprocessing
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+TIMEOUT = 10
+
+BINOPS = ["add", "sub", "mul", "xor", "and", "or", "shl", "lshr", "ashr",
+          "udiv", "urem"]
+CMPS = ["eq", "ne", "slt", "sle", "sgt", "sge", "ult", "ugt"]
+
+
+#
+# Program representation
+#
+# A program is a function @compute with nargs i32 arguments and nvars i32
+# locals. Statements are tuples:
+#   ("assign", dst, expr)       expr is ("const", c), ("var", v), ("arg", a)
+#                               or ("binop", op, lhs, rhs)
+#   ("if", (cmp, var, c), then_stmts, else_stmts)
+#   ("loop", trips, body_stmts)
+#   ("print", var)
+#   ("escape", var)             call @clobber(i32* %v<var>)
+#
+
+
+class Program:
+    def __init__(self, nargs, nvars, args, body):
+        self.nargs = nargs
+        self.nvars = nvars
+        self.args = args
+        self.body = body
+
+
+def gen_operand(rng, prog_nargs, nvars):
+    r = rng.random()
+    if r < 0.5:
+        return ("var", rng.randrange(nvars))
+    if r < 0.75 and prog_nargs:
+        return ("arg", rng.randrange(prog_nargs))
+    return ("const", rng.randint(-8, 64))
+
+
+def gen_expr(rng, nargs, nvars):
+    r = rng.random()
+    if r < 0.25:
+        return ("const", rng.randint(-100, 100))
+    if r < 0.5:
+        return ("var", rng.randrange(nvars))
+    if r < 0.6 and nargs:
+        return ("arg", rng.randrange(nargs))
+    return ("binop", rng.choice(BINOPS), gen_operand(rng, nargs, nvars),
+            gen_operand(rng, nargs, nvars))
+
+
+def gen_stmts(rng, nargs, nvars, budget, depth, escapes):
+    stmts = []
+    while budget > 0:
+        budget -= 1
+        r = rng.random()
+        if r < 0.12 and depth < 3:
+            n = rng.randint(1, 4)
+            stmts.append(("if", (rng.choice(CMPS), rng.randrange(nvars),
+                                 rng.randint(-10, 50)),
+                          gen_stmts(rng, nargs, nvars, n, depth + 1, escapes),
+                          gen_stmts(rng, nargs, nvars, rng.randint(0, 3),
+                                    depth + 1, escapes)))
+        elif r < 0.2 and depth < 3:
+            stmts.append(("loop", rng.randint(0, 4),
+                          gen_stmts(rng, nargs, nvars, rng.randint(1, 4),
+                                    depth + 1, escapes)))
+        elif r < 0.27:
+            stmts.append(("print", rng.randrange(nvars)))
+        elif r < 0.32 and escapes:
+            stmts.append(("escape", rng.randrange(nvars)))
+        else:
+            stmts.append(("assign", rng.randrange(nvars),
+                          gen_expr(rng, nargs, nvars)))
+    return stmts
+
+
+def gen_program(seed, escapes):
+    rng = random.Random(seed)
+    nargs = rng.randint(0, 3)
+    nvars = rng.randint(2, 6)
+    args = [rng.randint(-20, 20) for _ in range(nargs)]
+    body = gen_stmts(rng, nargs, nvars, rng.randint(5, 30), 0, escapes)
+    return Program(nargs, nvars, args, body)
+
+
+#
+# IR emission
+#
+
+
+class Emitter:
+    def __init__(self, prog):
+        self.prog = prog
+        self.lines = []
+        self.ntemps = 0
+        self.nlabels = 0
+        self.nloops = 0
+
+    def temp(self):
+        self.ntemps += 1
+        return "%t{}".format(self.ntemps)
+
+    def label(self, name):
+        self.nlabels += 1
+        return "{}{}".format(name, self.nlabels)
+
+    def emit(self, line):
+        self.lines.append("  " + line)
+
+    def start_block(self, label):
+        self.lines.append("")
+        self.lines.append(label + ":")
+
+    def load_var(self, v):
+        t = self.temp()
+        self.emit("{} = load i32, i32* %v{}, align 4".format(t, v))
+        return t
+
+    def operand(self, op):
+        kind = op[0]
+        if kind == "const":
+            return str(op[1])
+        if kind == "var":
+            return self.load_var(op[1])
+        # arguments are read back from their .addr slot like clang -O0 does
+        t = self.temp()
+        self.emit("{} = load i32, i32* %a{}.addr, align 4".format(t, op[1]))
+        return t
+
+    def expr(self, e):
+        if e[0] != "binop":
+            return self.operand(e)
+        op, lhs, rhs = e[1], self.operand(e[2]), self.operand(e[3])
+        if op in ("shl", "lshr", "ashr"):
+            # keep the shift amount in range
+            masked = self.temp()
+            self.emit("{} = and i32 {}, 31".format(masked, rhs))
+            rhs = masked
+        elif op in ("udiv", "urem"):
+            # never divide by zero
+            nonzero = self.temp()
+            self.emit("{} = or i32 {}, 1".format(nonzero, rhs))
+            rhs = nonzero
+        t = self.temp()
+        self.emit("{} = {} i32 {}, {}".format(t, op, lhs, rhs))
+        return t
+
+    def print_var(self, v):
+        val = self.load_var(v)
+        t = self.temp()
+        self.emit("{} = call i32 (i8*, ...) @printf(i8* getelementptr "
+                  "inbounds ([4 x i8], [4 x i8]* @.fmt, i64 0, i64 0), "
+                  "i32 {})".format(t, val))
+
+    def stmts(self, stmts):
+        for s in stmts:
+            kind = s[0]
+            if kind == "assign":
+                val = self.expr(s[2])
+                self.emit("store i32 {}, i32* %v{}, align 4".format(val, s[1]))
+            elif kind == "print":
+                self.print_var(s[1])
+            elif kind == "escape":
+                self.emit("call void @clobber(i32* %v{})".format(s[1]))
+            elif kind == "if":
+                cmp, v, c = s[1]
+                then_l = self.label("if.then")
+                else_l = self.label("if.else")
+                end_l = self.label("if.end")
+                val = self.load_var(v)
+                cond = self.temp()
+                self.emit("{} = icmp {} i32 {}, {}".format(cond, cmp, val, c))
+                self.emit("br i1 {}, label %{}, label %{}".format(
+                    cond, then_l, else_l))
+                self.start_block(then_l)
+                self.stmts(s[2])
+                self.emit("br label %{}".format(end_l))
+                self.start_block(else_l)
+                self.stmts(s[3])
+                self.emit("br label %{}".format(end_l))
+                self.start_block(end_l)
+            elif kind == "loop":
+                # each loop owns a counter that the body never assigns
+                self.nloops += 1
+                counter = "%lc{}".format(self.nloops)
+                cond_l = self.label("for.cond")
+                body_l = self.label("for.body")
+                end_l = self.label("for.end")
+                self.emit("store i32 0, i32* {}, align 4".format(counter))
+                self.emit("br label %{}".format(cond_l))
+                self.start_block(cond_l)
+                i = self.temp()
+                self.emit("{} = load i32, i32* {}, align 4".format(i, counter))
+                cond = self.temp()
+                self.emit("{} = icmp slt i32 {}, {}".format(cond, i, s[1]))
+                self.emit("br i1 {}, label %{}, label %{}".format(
+                    cond, body_l, end_l))
+                self.start_block(body_l)
+                self.stmts(s[2])
+                i = self.temp()
+                self.emit("{} = load i32, i32* {}, align 4".format(i, counter))
+                inc = self.temp()
+                self.emit("{} = add i32 {}, 1".format(inc, i))
+                self.emit("store i32 {}, i32* {}, align 4".format(inc, counter))
+                self.emit("br label %{}".format(cond_l))
+                self.start_block(end_l)
+
+
+def count_loops(stmts):
+    n = 0
+    for s in stmts:
+        if s[0] == "loop":
+            n += 1 + count_loops(s[2])
+        elif s[0] == "if":
+            n += count_loops(s[2]) + count_loops(s[3])
+    return n
+
+
+def emit_program(prog):
+    em = Emitter(prog)
+    em.stmts(prog.body)
+    # print every variable at the end so all final values are observable
+    for v in range(prog.nvars):
+        em.print_var(v)
+
+    params = ", ".join("i32 %a{}".format(i) for i in range(prog.nargs))
+    out = []
+    out.append('@.fmt = private unnamed_addr constant [4 x i8] c"%d\\0A\\00"')
+    out.append("")
+    out.append("declare i32 @printf(i8*, ...)")
+    out.append("")
+    out.append("define void @clobber(i32* %p) noinline {")
+    out.append("entry:")
+    out.append("  %0 = load i32, i32* %p, align 4")
+    out.append("  %1 = mul i32 %0, 3")
+    out.append("  %2 = add i32 %1, 1")
+    out.append("  store i32 %2, i32* %p, align 4")
+    out.append("  ret void")
+    out.append("}")
+    out.append("")
+    out.append("define i32 @compute({}) noinline {{".format(params))
+    out.append("entry:")
+    for i in range(prog.nargs):
+        out.append("  %a{0}.addr = alloca i32, align 4".format(i))
+    for v in range(prog.nvars):
+        out.append("  %v{} = alloca i32, align 4".format(v))
+    for l in range(count_loops(prog.body)):
+        out.append("  %lc{} = alloca i32, align 4".format(l + 1))
+    for i in range(prog.nargs):
+        out.append("  store i32 %a{0}, i32* %a{0}.addr, align 4".format(i))
+    for v in range(prog.nvars):
+        out.append("  store i32 {}, i32* %v{}, align 4".format(v * 7 + 1, v))
+    out.extend(em.lines)
+    out.append("  %ret = load i32, i32* %v0, align 4")
+    out.append("  ret i32 %ret")
+    out.append("}")
+    out.append("")
+    out.append("define i32 @main() {")
+    out.append("entry:")
+    args = ", ".join("i32 {}".format(a) for a in prog.args)
+    out.append("  %r = call i32 @compute({})".format(args))
+    out.append("  %m = and i32 %r, 255")
+    out.append("  ret i32 %m")
+    out.append("}")
+    return "\n".join(out) + "\n"
+
+
+#
+# Execution
+#
+
+
+def run(cmd, stdin=None):
+    try:
+        p = subprocess.run(cmd, input=stdin, stdout=subprocess.PIPE,
+                           stderr=subprocess.PIPE, timeout=TIMEOUT)
+        return p.returncode, p.stdout, p.stderr
+    except subprocess.TimeoutExpired:
+        return "timeout", b"", b""
+
+
+def execute(ir_path):
+    code, out, _ = run(["lli", ir_path])
+    return (code, out)
+
+
+def optimize(plugin, ir_path, out_path):
+    code, _, err = run(["opt", "-enable-new-pm=0", "-load", plugin,
+                        "-copy_prop", ir_path, "-o", out_path])
+    if code != 0:
+        return err.decode(errors="replace").strip().splitlines()[:1] or \
+            ["opt exited with {}".format(code)]
+    return None
+
+
+def check(ir, plugins, workdir):
+    """
+    Returns None if every plugin preserves the behaviour of ir, or a short
+    description of the first difference.
+    """
+    src = os.path.join(workdir, "input.ll")
+    with open(src, "w") as f:
+        f.write(ir)
+    expected = execute(src)
+    if expected[0] == "timeout":
+        return None
+
+    for name, plugin in plugins:
+        dst = os.path.join(workdir, name + ".bc")
+        err = optimize(plugin, src, dst)
+        if err:
+            return "{}: opt failed: {}".format(name, err[0])
+        actual = execute(dst)
+        if actual != expected:
+            return "{}: expected exit {} and {} output lines, got exit {} " \
+                   "and {}".format(name, expected[0],
+                                   len(expected[1].splitlines()), actual[0],
+                                   len(actual[1].splitlines()))
+    return None
+
+
+#
+# Minimization
+#
+
+
+def candidates(stmts):
+    """
+    Yields smaller variants of a statement list: whole chunks removed (ddmin
+    style, largest first), then compound statements replaced by their
+    children, then children minimized in place.
+    """
+    n = len(stmts)
+    chunk = n
+    while chunk >= 1:
+        for start in range(0, n, chunk):
+            yield stmts[:start] + stmts[start + chunk:]
+        chunk //= 2
+
+    for i, s in enumerate(stmts):
+        if s[0] == "if":
+            yield stmts[:i] + s[2] + stmts[i + 1:]
+            yield stmts[:i] + s[3] + stmts[i + 1:]
+        elif s[0] == "loop":
+            yield stmts[:i] + s[2] + stmts[i + 1:]
+            if s[1] > 1:
+                yield stmts[:i] + [("loop", 1, s[2])] + stmts[i + 1:]
+        elif s[0] == "assign" and s[2][0] == "binop":
+            yield stmts[:i] + [("assign", s[1], s[2][2])] + stmts[i + 1:]
+            yield stmts[:i] + [("assign", s[1], s[2][3])] + stmts[i + 1:]
+
+    for i, s in enumerate(stmts):
+        if s[0] == "if":
+            for sub in candidates(s[2]):
+                yield stmts[:i] + [("if", s[1], sub, s[3])] + stmts[i + 1:]
+            for sub in candidates(s[3]):
+                yield stmts[:i] + [("if", s[1], s[2], sub)] + stmts[i + 1:]
+        elif s[0] == "loop":
+            for sub in candidates(s[2]):
+                yield stmts[:i] + [("loop", s[1], sub)] + stmts[i + 1:]
+
+
+def minimize(prog, plugins, workdir):
+    body = prog.body
+    progress = True
+    while progress:
+        progress = False
+        for cand in candidates(body):
+            trial = Program(prog.nargs, prog.nvars, prog.args, cand)
+            if check(emit_program(trial), plugins, workdir):
+                body = cand
+                progress = True
+                break
+    return Program(prog.nargs, prog.nvars, prog.args, body)
+
+
+#
+# Driver
+#
+
+
+def fuzz_one(job):
+    seed, args = job
+    plugins = [("test", args.plugin)]
+    if args.ref:
+        plugins.append(("ref", args.ref))
+
+    prog = gen_program(seed, args.escapes)
+    ir = emit_program(prog)
+    with tempfile.TemporaryDirectory(prefix="cpass-fuzz-") as workdir:
+        failure = check(ir, plugins, workdir)
+        if not failure:
+            return seed, None
+        small = minimize(prog, plugins, workdir)
+        small_failure = check(emit_program(small), plugins, workdir)
+
+    os.makedirs(args.out, exist_ok=True)
+    with open(os.path.join(args.out, "seed-{}.ll".format(seed)), "w") as f:
+        f.write("; {}\n".format(failure))
+        f.write(ir)
+    with open(os.path.join(args.out, "seed-{}.min.ll".format(seed)), "w") as f:
+        f.write("; {}\n".format(small_failure or failure))
+        f.write(emit_program(small))
+    return seed, failure
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="differential execution fuzzer for copy_prop")
+    parser.add_argument("--runs", type=int, default=200)
+    parser.add_argument("--jobs", type=int, default=os.cpu_count())
+    parser.add_argument("--seed", type=int, default=0,
+                        help="first seed; run i uses seed + i")
+    parser.add_argument("--plugin", default="build/copy_prop/libcopy_prop.so")
+    parser.add_argument("--ref", default=None,
+                        help="also check the reference plugin")
+    parser.add_argument("--escapes", action="store_true")
+    parser.add_argument("--out", default="fuzz/failures")
+    parser.add_argument("--emit", type=int, metavar="SEED",
+                        help="print the program for SEED and exit")
+    args = parser.parse_args()
+
+    if args.emit is not None:
+        sys.stdout.write(emit_program(gen_program(args.emit, args.escapes)))
+        return 0
+
+    for plugin in [args.plugin] + ([args.ref] if args.ref else []):
+        if not os.path.isfile(plugin):
+            print("missing plugin {}".format(plugin))
+            return 2
+
+    jobs = [(args.seed + i, args) for i in range(args.runs)]
+    failures = 0
+    with multiprocessing.Pool(args.jobs) as pool:
+        for seed, failure in pool.imap_unordered(fuzz_one, jobs):
+            if failure:
+                failures += 1
+                print("seed {}: {} (minimized: {}/seed-{}.min.ll)".format(
+                    seed, failure, args.out, seed))
+                sys.stdout.flush()
+
+    print("{}/{} programs miscompiled".format(failures, args.runs))
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
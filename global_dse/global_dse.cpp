@@ -0,0 +1,127 @@
+#include <vector>
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "data_flow.h"
+#include "local_variables.h"
+
+using namespace llvm;
+using namespace std;
+
+/*
+ * global_dse removes stores whose value is not read on any path, by the
+ * liveness of memory locations, a companion pass to copy_prop built on the
+ * same data-flow solvers. It is meant to run after copy_prop, which leaves
+ * behind the stores whose loads it replaced.
+ *
+ * The locations are the local variables (see LocalVariables): nothing but
+ * their loads can read them, and they are dead once the function returns.
+ * A location is live where some path on from there loads it before storing
+ * to it: the COPY set of a block holds the locations it loads before
+ * storing to them, KILL the locations it stores to, and solveBackward gives
+ * in CPOut the locations live at the end of the block. A store to a
+ * location that is not live right after it is removed.
+ */
+namespace {
+
+/*
+ * DeadStores holds the state of the pass for one function. Stores in
+ * unreachable blocks are left alone.
+ */
+class DeadStores {
+ public:
+  explicit DeadStores(Function &F) : cfg(F), vars(F) {}
+  /* run removes the dead stores and returns how many */
+  unsigned int run();
+
+ private:
+  cpass::CFGNumbering cfg;
+  cpass::LocalVariables vars;
+};
+
+unsigned int DeadStores::run() {
+  if (!vars.size()) return 0;
+
+  BumpPtrAllocator arena;
+  uint32_t b, l, nr_blocks = cfg.rpo.size();
+  auto *blocks =
+      arena.Allocate<cpass::BasicBlockInfo<cpass::BitSet>>(nr_blocks);
+  for (b = 0; b < nr_blocks; b++) {
+    cpass::BasicBlockInfo<cpass::BitSet> &bbi = *new (&blocks[b])
+        cpass::BasicBlockInfo<cpass::BitSet>(arena, vars.size());
+    // walk the block backwards, so that a location stored to after it is
+    // loaded is still used
+    for (Instruction &ins : reverse(*cfg.rpo[b])) {
+      if ((l = vars.variableOf(ins)) == cpass::LocalVariables::NONE) continue;
+      if (isa<LoadInst>(ins)) {
+        bbi.COPY.set(l);
+      } else {
+        bbi.COPY.reset(l);
+        bbi.KILL.set(l);
+      }
+    }
+  }
+  cpass::solveBackward(blocks, cfg.succ_begin.data(), cfg.succs.data(),
+                       nr_blocks);
+
+  std::vector<StoreInst *> dead;
+  cpass::BitSet live(arena, vars.size());
+  for (b = 0; b < nr_blocks; b++) {
+    memcpy(live.data(), blocks[b].CPOut.data(),
+           live.numWords() * sizeof(cpass::BitWord));
+    for (Instruction &ins : reverse(*cfg.rpo[b])) {
+      if ((l = vars.variableOf(ins)) == cpass::LocalVariables::NONE) continue;
+      if (isa<LoadInst>(ins)) {
+        live.set(l);
+      } else if (live.test(l)) {
+        live.reset(l);
+      } else {
+        dead.push_back(cast<StoreInst>(&ins));
+      }
+    }
+  }
+  for (StoreInst *store : dead) {
+    store->eraseFromParent();
+  }
+  return dead.size();
+}
+
+class DeadStoreElimination : public FunctionPass {
+ public:
+  static char ID;
+  static cl::opt<bool> dse_stats;
+  unsigned int removed = 0;
+  DeadStoreElimination() : FunctionPass(ID) {}
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.setPreservesCFG();
+  }
+
+  bool runOnFunction(Function &F) override {
+    unsigned int n = DeadStores(F).run();
+    removed += n;
+    return n > 0;
+  }
+
+  bool doFinalization(Module &M) override {
+    if (dse_stats) {
+      errs() << "global_dse: " << removed << " stores removed\n";
+    }
+    removed = 0;
+    return false;
+  }
+};  // end DeadStoreElimination
+}  // end anonymous namespace
+
+char DeadStoreElimination::ID = 0;
+static RegisterPass<DeadStoreElimination> X(
+    "global_dse", "global dead store elimination",
+    false /* Only looks at CFG */, false /* Analysis Pass */);
+
+cl::opt<bool> DeadStoreElimination::dse_stats(
+    "dse-stats", cl::desc("print the number of stores removed"),
+    cl::init(false));
@@ -0,0 +1,47 @@
+#include "cpass_jit.h"
+
+#include "llvm/IR/Module.h"
+
+#include "cpass.h"
+
+using namespace llvm;
+using namespace llvm::orc;
+
+namespace cpass {
+
+void CopyPropTransform::setTier(const JITDylib &jd, JITTier tier) {
+  std::lock_guard<std::mutex> lock(tiers_lock);
+  tiers[&jd] = tier;
+}
+
+JITTier CopyPropTransform::getTier(const JITDylib &jd) {
+  std::lock_guard<std::mutex> lock(tiers_lock);
+  auto it = tiers.find(&jd);
+  return it == tiers.end() ? default_tier : it->second;
+}
+
+Expected<ThreadSafeModule> CopyPropTransform::operator()(
+    ThreadSafeModule tsm, MaterializationResponsibility &r) {
+  JITTier tier = getTier(r.getTargetJITDylib());
+  tsm.withModuleDo([tier](Module &m) { optimizeModule(m, tier); });
+  return std::move(tsm);
+}
+
+void optimizeModule(Module &m, JITTier tier) {
+  Options opts;
+  opts.global = tier == JITTier::Global;
+  for (Function &f : m) {
+    if (!f.isDeclaration()) {
+      propagate(f, opts);
+    }
+  }
+}
+
+void addCopyPropTransform(LLJIT &jit, CopyPropTransform &transform) {
+  jit.getIRTransformLayer().setTransform(
+      [&transform](ThreadSafeModule tsm, MaterializationResponsibility &r) {
+        return transform(std::move(tsm), r);
+      });
+}
+
+}  // namespace cpass
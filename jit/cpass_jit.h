@@ -0,0 +1,58 @@
+#ifndef CPASS_JIT_H
+#define CPASS_JIT_H
+
+#include <map>
+#include <mutex>
+
+#include "llvm/ExecutionEngine/Orc/IRTransformLayer.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+
+namespace cpass {
+
+/*
+ * Optimization tiers for JIT-compiled code. Local only runs local copy
+ * propagation, which is linear in the size of each block and suited to the
+ * first compile of a function. Global runs the full pass (local and global
+ * propagation) and is meant for re-optimizing hot functions.
+ */
+enum class JITTier { Local, Global };
+
+/*
+ * CopyPropTransform runs copy_prop over every function in a module as it
+ * passes through an IRTransformLayer. The tier is chosen per JITDylib, so a
+ * JIT can keep its first-tier code in one dylib and re-add hot functions to
+ * another dylib compiled with the global tier.
+ */
+class CopyPropTransform {
+ private:
+  JITTier default_tier;
+  std::map<const llvm::orc::JITDylib *, JITTier> tiers;
+  std::mutex tiers_lock;
+
+ public:
+  CopyPropTransform(JITTier default_tier = JITTier::Local)
+      : default_tier(default_tier) {}
+
+  void setTier(const llvm::orc::JITDylib &jd, JITTier tier);
+  JITTier getTier(const llvm::orc::JITDylib &jd);
+
+  llvm::Expected<llvm::orc::ThreadSafeModule> operator()(
+      llvm::orc::ThreadSafeModule tsm,
+      llvm::orc::MaterializationResponsibility &r);
+};
+
+/*
+ * optimizeModule runs copy_prop at the given tier over every function
+ * defined in m.
+ */
+void optimizeModule(llvm::Module &m, JITTier tier);
+
+/*
+ * addCopyPropTransform installs transform as the IR transform of jit. The
+ * transform must outlive the JIT.
+ */
+void addCopyPropTransform(llvm::orc::LLJIT &jit, CopyPropTransform &transform);
+
+}  // namespace cpass
+
+#endif  // CPASS_JIT_H
@@ -0,0 +1,151 @@
+/*
+ * cpass-jit: example JIT driver using copy_prop as an IR transform.
+ *
+ * Runs the entry function (main by default) of an IR file in an LLJIT whose
+ * IR transform layer applies copy_prop. Code is first compiled with the local
+ * tier; with -tier-up-after=N the module is re-added to a second JITDylib
+ * compiled with the global tier once the entry function has run N times,
+ * and the remaining runs use the re-optimized code. The second copy defines
+ * only the functions: its global variables are declarations resolved to the
+ * first copy's, so state written before tiering up is kept.
+ *
+ * usage: cpass-jit [-tier=local|global] [-runs=N] [-tier-up-after=N]
+ *                  [-entry=main] [-time] input.ll [args...]
+ */
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/TargetProcess/TargetExecutionUtils.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+
+#include "cpass_jit.h"
+
+using namespace llvm;
+using namespace llvm::orc;
+using namespace std;
+
+static cl::opt<string> input_file(cl::Positional, cl::desc("<input file>"),
+                                  cl::Required);
+static cl::list<string> input_args(cl::ConsumeAfter,
+                                   cl::desc("<program arguments>..."));
+static cl::opt<cpass::JITTier> first_tier(
+    "tier", cl::desc("tier used for the first compile"),
+    cl::init(cpass::JITTier::Local),
+    cl::values(clEnumValN(cpass::JITTier::Local, "local",
+                          "local copy propagation only"),
+               clEnumValN(cpass::JITTier::Global, "global",
+                          "local and global copy propagation")));
+static cl::opt<string> entry_name("entry", cl::desc("function to run"),
+                                  cl::init("main"));
+static cl::opt<unsigned> runs("runs", cl::desc("number of times to run"),
+                              cl::init(1));
+static cl::opt<unsigned> tier_up_after(
+    "tier-up-after",
+    cl::desc("re-optimize with the global tier after this many runs "
+             "(0 = never)"),
+    cl::init(0));
+static cl::opt<bool> print_time("time",
+                                cl::desc("print the time taken to compile"),
+                                cl::init(false));
+
+static ExitOnError exit_on_err;
+
+/*
+ * loadModule parses the input file into a fresh context, so the same IR can
+ * be added to more than one JITDylib. With import_globals the global
+ * variables are made declarations, to be resolved to the definitions of a
+ * copy already added; otherwise they are all made visible outside the
+ * JITDylib, so that such a copy can link to them.
+ */
+static ThreadSafeModule loadModule(bool import_globals) {
+  auto ctx = std::make_unique<LLVMContext>();
+  SMDiagnostic err;
+  std::unique_ptr<Module> m = parseIRFile(input_file, err, *ctx);
+  if (!m) {
+    err.print("cpass-jit", errs());
+    exit(1);
+  }
+
+  // every copy is parsed from the same file, so names given here match
+  unsigned nr_unnamed = 0;
+  for (GlobalVariable &gv : m->globals()) {
+    if (gv.isDeclaration()) continue;
+    if (!gv.hasName()) {
+      gv.setName("__cpass_jit_global." + Twine(nr_unnamed++));
+    }
+    if (gv.hasLocalLinkage() || import_globals) {
+      gv.setLinkage(GlobalValue::ExternalLinkage);
+    }
+    gv.setVisibility(GlobalValue::DefaultVisibility);
+    if (import_globals) {
+      gv.setInitializer(nullptr);
+      gv.setComdat(nullptr);
+      // the definition is in another JITDylib, which may be anywhere
+      gv.setDSOLocal(false);
+    }
+  }
+  return ThreadSafeModule(std::move(m), std::move(ctx));
+}
+
+/*
+ * compileEntry adds the input module to jd and looks up the entry function,
+ * which triggers compilation. It returns the address of the entry function.
+ * With import_globals the module's global variables are those of the copy
+ * in the main JITDylib.
+ */
+static JITTargetAddress compileEntry(LLJIT &jit, JITDylib &jd,
+                                     bool import_globals) {
+  char prefix = jit.getDataLayout().getGlobalPrefix();
+  if (import_globals) {
+    jd.addToLinkOrder(jit.getMainJITDylib());
+  }
+  jd.addGenerator(exit_on_err(
+      DynamicLibrarySearchGenerator::GetForCurrentProcess(prefix)));
+  exit_on_err(jit.addIRModule(jd, loadModule(import_globals)));
+
+  auto start = chrono::steady_clock::now();
+  JITEvaluatedSymbol sym = exit_on_err(jit.lookup(jd, entry_name));
+  auto end = chrono::steady_clock::now();
+
+  if (print_time) {
+    errs() << jd.getName() << ": compiled in "
+           << chrono::duration_cast<chrono::microseconds>(end - start).count()
+           << " us\n";
+  }
+  return sym.getAddress();
+}
+
+int main(int argc, char **argv) {
+  InitLLVM init(argc, argv);
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+  cl::ParseCommandLineOptions(argc, argv, "copy_prop JIT driver\n");
+  exit_on_err.setBanner("cpass-jit: ");
+
+  cpass::CopyPropTransform transform(first_tier);
+  std::unique_ptr<LLJIT> jit = exit_on_err(LLJITBuilder().create());
+  cpass::addCopyPropTransform(*jit, transform);
+
+  typedef int (*MainFn)(int, char *[]);
+  MainFn entry = jitTargetAddressToFunction<MainFn>(
+      compileEntry(*jit, jit->getMainJITDylib(), false));
+
+  int ret = 0;
+  for (unsigned i = 0; i < runs; i++) {
+    if (tier_up_after && i == tier_up_after) {
+      JITDylib &hot = exit_on_err(jit->createJITDylib("hot"));
+      transform.setTier(hot, cpass::JITTier::Global);
+      entry = jitTargetAddressToFunction<MainFn>(compileEntry(*jit, hot, true));
+    }
+    ret = runAsMain(entry, input_args, StringRef(input_file));
+  }
+
+  return ret;
+}
@@ -0,0 +1,442 @@
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/ValueHandle.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/SSAUpdater.h"
+
+#include "data_flow.h"
+#include "local_variables.h"
+
+using namespace llvm;
+using namespace std;
+
+/*
+ * load_pre removes partially redundant loads of local variables by lazy
+ * code motion (Knoop, Ruthing and Steffen; Aho et al., 2nd ed., pp.
+ * 639-655), a companion pass to copy_prop built on the same data-flow
+ * solvers. A load that some paths to it already know the value of, such as
+ * a loop header reloading a variable stored in one arm of the body or a
+ * join after an if that stores in one arm, becomes a phi of the known
+ * values and of loads placed on the paths that lacked one. No path executes
+ * more loads than before.
+ *
+ * The variables are the LocalVariables of the function, including those
+ * that escape, and a set per block holds a bit per variable:
+ *
+ *   USE     the block loads the variable before anything may write it
+ *   STORE   the block stores to it, or for a variable that escapes holds
+ *           any other instruction that may write memory, so the value does
+ *           not pass through
+ *   ACCESS  the block loads or stores it after the last such instruction,
+ *           so its value at the end is known
+ *
+ * From these the pass solves, in order: the variables anticipated on entry
+ * to a block, loaded on every path from there before any store
+ * (solveBackward, MEET_INTERSECTION); the variables available on entry,
+ * known on every path to it either from an access or from a load the
+ * earliest placement would put there (solveForward); the earliest blocks a
+ * load can go to; how far down each placement can be postponed
+ * (solveForward); the latest blocks; and where a load placed there is
+ * still used (solveBackward). A load is placed at the start of the blocks
+ * in both latest and used, and the loads of a block that USE the variable
+ * are replaced by the value known on entry, found by SSAUpdater from the
+ * placed loads and the accesses, unless the block is latest but no longer
+ * used, where they stay as they are.
+ *
+ * The equations place loads at the start of blocks, so every edge into a
+ * block with more than one predecessor first gets a block of its own,
+ * where a load for that edge alone can go; the edge blocks that get no
+ * load are removed again, and those that do are merged into their
+ * predecessor when it has no other successor.
+ */
+namespace {
+
+/*
+ * LastAccess is the last load or store of a variable in a block, and
+ * whether it is a load that USEs the variable.
+ */
+struct LastAccess {
+  uint32_t var;
+  Instruction *ins;
+  bool exposed;
+};
+
+/*
+ * PartialRedundancies holds the state of the pass for one function. Loads
+ * in unreachable blocks are left alone.
+ */
+class PartialRedundancies {
+ public:
+  explicit PartialRedundancies(Function &F) : F(F), vars(F, true) {}
+  /*
+   * run moves the loads and returns whether it changed F; inserted and
+   * removed are incremented by the number of loads inserted and removed.
+   */
+  bool run(unsigned int &inserted, unsigned int &removed);
+
+ private:
+  Function &F;
+  cpass::LocalVariables vars;
+  // the blocks splitEdges added
+  std::vector<BasicBlock *> edge_blocks;
+
+  bool worthSplitting();
+  void splitEdges();
+  bool mergeEdges();
+};
+
+/*
+ * worthSplitting returns true if F loads a variable at all and has no edge
+ * that splitEdges could not split.
+ */
+bool PartialRedundancies::worthSplitting() {
+  if (!vars.size() || F.hasPersonalityFn()) return false;
+  bool loads = false;
+  for (BasicBlock &bb : F) {
+    Instruction *term = bb.getTerminator();
+    if (isa<IndirectBrInst>(term) || isa<CallBrInst>(term)) return false;
+    for (Instruction &ins : bb) {
+      loads |= isa<LoadInst>(ins) &&
+               vars.variableOf(ins) != cpass::LocalVariables::NONE;
+    }
+  }
+  return loads;
+}
+
+/*
+ * splitEdges gives every edge into a block with more than one predecessor
+ * a block of its own and records the new blocks in edge_blocks.
+ */
+void PartialRedundancies::splitEdges() {
+  std::vector<std::pair<BasicBlock *, unsigned int>> edges;
+  for (BasicBlock &bb : F) {
+    Instruction *term = bb.getTerminator();
+    for (unsigned int i = 0; i < term->getNumSuccessors(); i++) {
+      if (term->getSuccessor(i)->hasNPredecessorsOrMore(2)) {
+        edges.push_back({&bb, i});
+      }
+    }
+  }
+  for (auto &edge : edges) {
+    Instruction *term = edge.first->getTerminator();
+    BasicBlock *split = term->getNumSuccessors() == 1
+                            ? SplitBlock(edge.first, term)
+                            : SplitCriticalEdge(term, edge.second);
+    if (split) edge_blocks.push_back(split);
+  }
+}
+
+/*
+ * mergeEdges removes the edge blocks that hold nothing but their branch and
+ * merges the others into their predecessor where it has no other
+ * successor. Returns true if any edge block is left.
+ */
+bool PartialRedundancies::mergeEdges() {
+  bool left = false;
+  for (BasicBlock *bb : edge_blocks) {
+    if (MergeBlockIntoPredecessor(bb)) continue;
+    if (bb->size() == 1 && TryToSimplifyUncondBranchFromEmptyBlock(bb)) {
+      continue;
+    }
+    left = true;
+  }
+  return left;
+}
+
+bool PartialRedundancies::run(unsigned int &inserted, unsigned int &removed) {
+  if (!worthSplitting()) return false;
+  splitEdges();
+  unsigned int inserted_before = inserted;
+
+  cpass::CFGNumbering cfg(F);
+  BumpPtrAllocator arena;
+  uint32_t b, s, v, nr_blocks = cfg.rpo.size(), nr_vars = vars.size();
+  auto newSets = [&]() {
+    auto *sets = arena.Allocate<cpass::BasicBlockInfo<cpass::BitSet>>(
+        nr_blocks);
+    for (b = 0; b < nr_blocks; b++) {
+      new (&sets[b]) cpass::BasicBlockInfo<cpass::BitSet>(arena, nr_vars);
+    }
+    return sets;
+  };
+  // ant holds USE in COPY and STORE in KILL, and avail ACCESS in COPY
+  // until it is solved
+  auto *ant = newSets(), *avail = newSets(), *post = newSets(),
+       *used = newSets();
+  unsigned int w, nr_words = ant[0].COPY.numWords();
+
+  cpass::BitSet escaped(arena, nr_vars);
+  for (v = 0; v < nr_vars; v++) {
+    if (vars.escapes(v)) escaped.set(v);
+  }
+
+  // the loads that USE a variable in every block, as (variable, load), and
+  // the last access to every variable whose value a block knows at its end
+  std::vector<std::vector<std::pair<uint32_t, LoadInst *>>> exposed(
+      nr_blocks);
+  std::vector<std::vector<LastAccess>> last(nr_blocks);
+  // the position of the last access to every variable in the block, from 1
+  std::vector<uint32_t> last_pos(nr_vars, 0);
+  std::vector<LastAccess> last_access(nr_vars);
+  for (b = 0; b < nr_blocks; b++) {
+    uint32_t pos = 0, clobber_pos = 0;
+    for (Instruction &ins : *cfg.rpo[b]) {
+      pos++;
+      if ((v = vars.variableOf(ins)) == cpass::LocalVariables::NONE) {
+        if (!ins.mayWriteToMemory()) continue;
+        clobber_pos = pos;
+        cpass::BitWord *store = ant[b].KILL.data(),
+                       *access = avail[b].COPY.data();
+        for (w = 0; w < nr_words; w++) {
+          store[w] |= escaped.data()[w];
+          access[w] &= ~escaped.data()[w];
+        }
+        continue;
+      }
+      if (!last_pos[v]) last[b].push_back({v, nullptr, false});
+      last_pos[v] = pos;
+      last_access[v] = {v, &ins, false};
+      avail[b].COPY.set(v);
+      if (isa<StoreInst>(ins)) {
+        ant[b].KILL.set(v);
+      } else if (!ant[b].KILL.test(v)) {
+        ant[b].COPY.set(v);
+        exposed[b].push_back({v, cast<LoadInst>(&ins)});
+        last_access[v].exposed = true;
+      }
+    }
+    // an access before the last instruction that may write the variable
+    // otherwise does not tell its value at the end
+    size_t n = 0;
+    for (size_t i = 0; i < last[b].size(); i++) {
+      v = last[b][i].var;
+      if (!escaped.test(v) || last_pos[v] > clobber_pos) {
+        last[b][n++] = last_access[v];
+      }
+      last_pos[v] = 0;
+    }
+    last[b].resize(n);
+  }
+
+  // anticipated: CPIn(b) = USE(b) | (CPOut(b) & ~STORE(b)), CPOut(b) = the
+  // intersection of CPIn(s) over the successors s
+  cpass::solveBackward(ant, cfg.succ_begin.data(), cfg.succs.data(),
+                       nr_blocks, cpass::MEET_INTERSECTION);
+
+  // available: CPOut(b) = ACCESS(b) | ((ANTIn(b) | CPIn(b)) & ~STORE(b))
+  for (b = 0; b < nr_blocks; b++) {
+    cpass::BitWord *copy = avail[b].COPY.data(), *kill = avail[b].KILL.data();
+    const cpass::BitWord *ant_in = ant[b].CPIn.data(), *store = ant[b].KILL.data();
+    for (w = 0; w < nr_words; w++) {
+      copy[w] |= ant_in[w] & ~store[w];
+      kill[w] = store[w];
+    }
+  }
+  cpass::solveForward(avail, cfg.pred_begin.data(), cfg.preds.data(),
+                      nr_blocks);
+
+  // earliest: EARLIEST(b) = ANTIn(b) & ~AVAILIn(b), kept in avail's COPY
+  // sets, which are done with
+  for (b = 0; b < nr_blocks; b++) {
+    cpass::BitWord *earliest = avail[b].COPY.data();
+    const cpass::BitWord *ant_in = ant[b].CPIn.data(),
+                  *avail_in = avail[b].CPIn.data();
+    for (w = 0; w < nr_words; w++) {
+      earliest[w] = ant_in[w] & ~avail_in[w];
+    }
+  }
+
+  // postponable: CPOut(b) = (EARLIEST(b) | CPIn(b)) & ~USE(b)
+  for (b = 0; b < nr_blocks; b++) {
+    cpass::BitWord *copy = post[b].COPY.data(), *kill = post[b].KILL.data();
+    const cpass::BitWord *earliest = avail[b].COPY.data(), *use = ant[b].COPY.data();
+    for (w = 0; w < nr_words; w++) {
+      copy[w] = earliest[w] & ~use[w];
+      kill[w] = use[w];
+    }
+  }
+  cpass::solveForward(post, cfg.pred_begin.data(), cfg.preds.data(),
+                      nr_blocks);
+
+  // latest: LATEST(b) = (EARLIEST(b) | POSTIn(b)) & (USE(b) | ~the
+  // intersection of EARLIEST(s) | POSTIn(s) over the successors s), kept in
+  // post's COPY sets
+  cpass::BitSet succs_all(arena, nr_vars);
+  cpass::BitWord *all = succs_all.data();
+  for (b = 0; b < nr_blocks; b++) {
+    for (w = 0; w < nr_words; w++) all[w] = ~cpass::BitWord(0);
+    for (s = cfg.succ_begin[b]; s < cfg.succ_begin[b + 1]; s++) {
+      const cpass::BitWord *earliest = avail[cfg.succs[s]].COPY.data(),
+                    *post_in = post[cfg.succs[s]].CPIn.data();
+      for (w = 0; w < nr_words; w++) {
+        all[w] &= earliest[w] | post_in[w];
+      }
+    }
+    cpass::BitWord *latest = post[b].COPY.data();
+    const cpass::BitWord *earliest = avail[b].COPY.data(),
+                  *post_in = post[b].CPIn.data(), *use = ant[b].COPY.data();
+    for (w = 0; w < nr_words; w++) {
+      latest[w] = (earliest[w] | post_in[w]) & (use[w] | ~all[w]);
+    }
+  }
+
+  // used: CPIn(b) = (USE(b) | CPOut(b)) & ~LATEST(b), CPOut(b) = the union
+  // of CPIn(s) over the successors s
+  for (b = 0; b < nr_blocks; b++) {
+    cpass::BitWord *copy = used[b].COPY.data(), *kill = used[b].KILL.data();
+    const cpass::BitWord *latest = post[b].COPY.data(), *use = ant[b].COPY.data();
+    for (w = 0; w < nr_words; w++) {
+      copy[w] = use[w] & ~latest[w];
+      kill[w] = latest[w];
+    }
+  }
+  cpass::solveBackward(used, cfg.succ_begin.data(), cfg.succs.data(),
+                       nr_blocks);
+
+  // place a load at the start of the blocks that are latest and used, and
+  // replace the loads that USE a variable where the block is not latest or
+  // is used. Where the block has such a load the first one is the placed
+  // load, since nothing accesses the variable before it
+  DenseMap<std::pair<uint32_t, uint32_t>, LoadInst *> placed;
+  std::vector<std::vector<std::pair<uint32_t, LoadInst *>>> replaced(nr_vars);
+  for (b = 0; b < nr_blocks; b++) {
+    cpass::BitSet &latest = post[b].COPY, &used_out = used[b].CPOut;
+    for (v = 0; v < nr_vars; v++) {
+      if (!latest.test(v) || !used_out.test(v)) continue;
+      auto first = find_if(exposed[b].begin(), exposed[b].end(),
+                           [&](auto &e) { return e.first == v; });
+      if (first != exposed[b].end()) {
+        placed[{b, v}] = first->second;
+        continue;
+      }
+      // in the entry block, which the variable is allocated in, the load
+      // goes right after the alloca
+      AllocaInst *var = vars.get(v);
+      Instruction *at = b ? &*cfg.rpo[b]->getFirstInsertionPt()
+                          : var->getNextNode();
+      placed[{b, v}] =
+          new LoadInst(var->getAllocatedType(), var, var->getName() + ".pre",
+                       false, var->getAlign(), at);
+      inserted++;
+    }
+    for (auto &e : exposed[b]) {
+      auto it = placed.find({b, e.first});
+      if (it != placed.end() && it->second == e.second) continue;
+      if (!latest.test(e.first) || used_out.test(e.first)) {
+        replaced[e.first].push_back({b, e.second});
+      }
+    }
+  }
+
+  // the value of a variable at the end of the blocks that know it: the
+  // last store, a placed load, or a load that stays
+  std::vector<std::vector<std::pair<uint32_t, Value *>>> known(nr_vars);
+  for (b = 0; b < nr_blocks; b++) {
+    for (auto &l : last[b]) {
+      v = l.var;
+      if (auto *store = dyn_cast<StoreInst>(l.ins)) {
+        known[v].push_back({b, store->getValueOperand()});
+      } else if (!l.exposed) {
+        known[v].push_back({b, l.ins});
+      } else if (!placed.count({b, v}) &&
+                 (post[b].COPY.test(v) && !used[b].CPOut.test(v))) {
+        known[v].push_back({b, l.ins});
+      }
+    }
+  }
+  for (auto &p : placed) {
+    if (!ant[p.first.first].KILL.test(p.first.second)) {
+      known[p.first.second].push_back({p.first.first, p.second});
+    }
+  }
+
+  // every replacement is found before any load is replaced, since
+  // SSAUpdater looks through the stores, whose values may be loads that
+  // are replaced too; the handles follow them
+  std::vector<std::pair<LoadInst *, WeakTrackingVH>> replacements;
+  SmallVector<PHINode *, 8> phis;
+  for (v = 0; v < nr_vars; v++) {
+    if (replaced[v].empty()) continue;
+    AllocaInst *var = vars.get(v);
+    SSAUpdater ssa(&phis);
+    ssa.Initialize(var->getAllocatedType(), var->getName());
+    for (auto &k : known[v]) {
+      ssa.AddAvailableValue(cfg.rpo[k.first], k.second);
+    }
+    for (auto &r : replaced[v]) {
+      auto it = placed.find({r.first, v});
+      replacements.push_back(
+          {r.second, it != placed.end()
+                         ? it->second
+                         : ssa.GetValueInMiddleOfBlock(cfg.rpo[r.first])});
+    }
+  }
+  for (auto &r : replacements) {
+    r.first->replaceAllUsesWith(r.second);
+  }
+  for (auto &r : replacements) {
+    r.first->eraseFromParent();
+  }
+  removed += replacements.size();
+
+  // a phi joining a value only with itself around a loop has one value
+  DenseSet<PHINode *> erased;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (PHINode *phi : phis) {
+      if (erased.count(phi)) continue;
+      if (Value *value = phi->hasConstantValue()) {
+        phi->replaceAllUsesWith(value);
+        phi->eraseFromParent();
+        erased.insert(phi);
+        changed = true;
+      }
+    }
+  }
+
+  bool left = mergeEdges();
+  return left || inserted != inserted_before || !replacements.empty();
+}
+
+class LoadPRE : public FunctionPass {
+ public:
+  static char ID;
+  static cl::opt<bool> pre_stats;
+  unsigned int inserted = 0;
+  unsigned int removed = 0;
+  LoadPRE() : FunctionPass(ID) {}
+
+  bool runOnFunction(Function &F) override {
+    return PartialRedundancies(F).run(inserted, removed);
+  }
+
+  bool doFinalization(Module &M) override {
+    if (pre_stats) {
+      errs() << "load_pre: " << inserted << " loads inserted, " << removed
+             << " loads removed\n";
+    }
+    inserted = removed = 0;
+    return false;
+  }
+};  // end LoadPRE
+}  // end anonymous namespace
+
+char LoadPRE::ID = 0;
+static RegisterPass<LoadPRE> X("load_pre",
+                               "partial redundancy elimination of loads",
+                               false /* Only looks at CFG */,
+                               false /* Analysis Pass */);
+
+cl::opt<bool> LoadPRE::pre_stats(
+    "pre-stats", cl::desc("print the number of loads inserted and removed"),
+    cl::init(false));
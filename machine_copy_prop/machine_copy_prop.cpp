@@ -0,0 +1,445 @@
+#include <algorithm>
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/CodeGen/TargetInstrInfo.h"
+#include "llvm/CodeGen/TargetRegisterInfo.h"
+#include "llvm/CodeGen/TargetSubtargetInfo.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "data_flow.h"
+
+using namespace llvm;
+using namespace std;
+
+/*
+ * machine_copy_prop is copy propagation over the register COPY
+ * instructions that instruction selection and register allocation leave
+ * behind, which the IR-level copy_prop never sees. It follows copy_prop:
+ * a local phase propagates the copies made in each block through the block
+ * (Muchnick, pp. 357-358), and a global phase solves the copies available
+ * on entry to every block with solveForward and propagates those too
+ * (Muchnick, pp. 358-362).
+ *
+ * A copy is a COPY between two virtual or two physical registers, without
+ * subregister indices. Its ACP entry maps the destination to the source,
+ * and any definition of a register that overlaps either, or a call's
+ * register mask that clobbers either, kills it. A use of the destination
+ * where the copy is available reads the source instead, if the instruction
+ * accepts that register there: virtual registers must be of a compatible
+ * class, and physical registers are only put into explicit operands that
+ * are not tied, of a class that contains them. A virtual copy left with no
+ * uses is removed.
+ *
+ * The pass runs in llc on MIR, with -load and -run-pass=machine_copy_prop.
+ */
+namespace {
+
+/*
+ * RegACPTable maps the destination of every available copy to its source,
+ * as ACPTable does for copy_prop.
+ */
+typedef DenseMap<Register, Register> RegACPTable;
+
+/*
+ * MachineCopy is the entry for one copy in the copy table, with the source
+ * it had when the table was built.
+ */
+struct MachineCopy {
+  MachineInstr *mi;
+  Register dst;
+  Register src;
+};
+
+/*
+ * RegisterCopies holds the state of the pass for one function. Blocks are
+ * numbered by their position in reverse post order; unreachable blocks are
+ * only propagated through locally.
+ */
+class RegisterCopies {
+ public:
+  explicit RegisterCopies(MachineFunction &MF);
+  /*
+   * run propagates the copies of the function; replaced and removed are
+   * incremented by the number of uses replaced and copies removed. Returns
+   * true if the function was modified.
+   */
+  bool run(unsigned int &replaced, unsigned int &removed);
+
+ private:
+  MachineFunction &MF;
+  MachineRegisterInfo &MRI;
+  const TargetRegisterInfo &TRI;
+  const TargetInstrInfo &TII;
+  // the sources put in place of other registers, whose kill flags no
+  // longer hold
+  DenseSet<Register> sources;
+  // whether a physical source was put in a block the copy is not in
+  bool global_physical = false;
+  // the copy table and the blocks, for the global phase
+  std::vector<MachineCopy> copies;
+  std::vector<MachineBasicBlock *> rpo;
+  std::vector<uint32_t> pred_begin;
+  std::vector<uint32_t> preds;
+
+  bool isCopy(const MachineInstr &MI) const;
+  bool canReplace(MachineInstr &MI, unsigned int i, Register src);
+  unsigned int propagateBlock(MachineBasicBlock &MBB, RegACPTable &acp,
+                              bool global);
+  unsigned int globalPropagation();
+  unsigned int removeDeadCopies();
+  void clearKillFlags();
+  void addLiveIns();
+};
+
+RegisterCopies::RegisterCopies(MachineFunction &MF)
+    : MF(MF),
+      MRI(MF.getRegInfo()),
+      TRI(*MF.getSubtarget().getRegisterInfo()),
+      TII(*MF.getSubtarget().getInstrInfo()) {}
+
+/*
+ * isCopy returns true if MI is a copy the pass propagates.
+ */
+bool RegisterCopies::isCopy(const MachineInstr &MI) const {
+  if (!MI.isCopy()) return false;
+  const MachineOperand &dst = MI.getOperand(0), &src = MI.getOperand(1);
+  if (dst.getSubReg() || src.getSubReg() || src.isUndef()) return false;
+  Register d = dst.getReg(), s = src.getReg();
+  if (d == s || d.isVirtual() != s.isVirtual()) return false;
+  if (d.isVirtual()) {
+    return MRI.getRegClassOrNull(d) && MRI.getRegClassOrNull(s);
+  }
+  return !MRI.isReserved(d) && !MRI.isReserved(s);
+}
+
+/*
+ * canReplace returns true if operand i of MI, a use of the destination of a
+ * copy, may read src instead. A virtual src may have its class narrowed to
+ * fit.
+ */
+bool RegisterCopies::canReplace(MachineInstr &MI, unsigned int i,
+                                Register src) {
+  MachineOperand &MO = MI.getOperand(i);
+  if (MO.getReg().isVirtual()) {
+    if (MI.isDebugInstr()) return true;
+    if (MO.isTied() && !MRI.isSSA()) return false;
+    return MRI.constrainRegClass(src, MRI.getRegClass(MO.getReg()));
+  }
+  if (MI.isDebugInstr() || MO.isImplicit() || MO.isTied()) return false;
+  const TargetRegisterClass *rc = MI.getRegClassConstraint(i, &TII, &TRI);
+  return rc ? rc->contains(src) : MI.isCopy();
+}
+
+/*
+ * propagateBlock performs copy propagation over MBB using the available
+ * copies in acp, which is updated with the copies made in MBB; global is
+ * set for the global phase. A copy that has become a copy of a register to
+ * itself is removed. Returns the number of uses replaced.
+ */
+unsigned int RegisterCopies::propagateBlock(MachineBasicBlock &MBB,
+                                            RegACPTable &acp, bool global) {
+  std::vector<MachineInstr *> to_remove;
+  unsigned int replaced = 0;
+
+  for (MachineInstr &MI : MBB) {
+    // replace the uses of copy destinations
+    for (unsigned int i = 0; i < MI.getNumOperands(); i++) {
+      MachineOperand &MO = MI.getOperand(i);
+      if (!MO.isReg() || !MO.isUse() || !MO.getReg() || MO.isUndef()) {
+        continue;
+      }
+      auto it = acp.find(MO.getReg());
+      if (it == acp.end() || !canReplace(MI, i, it->second)) continue;
+      Register src = it->second;
+      MO.setReg(src);
+      MO.setIsKill(false);
+      if (src.isPhysical()) {
+        if (MO.isRenamable()) MO.setIsRenamable(false);
+        global_physical |= global;
+      }
+      sources.insert(src);
+      replaced++;
+    }
+
+    if (MI.isCopy() &&
+        MI.getOperand(0).getReg() == MI.getOperand(1).getReg() &&
+        MI.getOperand(0).getSubReg() == MI.getOperand(1).getSubReg()) {
+      to_remove.push_back(&MI);
+      continue;
+    }
+
+    // kill the copies whose destination or source is defined or clobbered
+    for (MachineOperand &MO : MI.operands()) {
+      if (MO.isRegMask()) {
+        for (auto it = acp.begin(); it != acp.end();) {
+          auto cur = it++;
+          if (cur->first.isPhysical() &&
+              (MO.clobbersPhysReg(cur->first) ||
+               MO.clobbersPhysReg(cur->second))) {
+            acp.erase(cur);
+          }
+        }
+      } else if (MO.isReg() && MO.isDef() && MO.getReg()) {
+        for (auto it = acp.begin(); it != acp.end();) {
+          auto cur = it++;
+          if (TRI.regsOverlap(cur->first, MO.getReg()) ||
+              TRI.regsOverlap(cur->second, MO.getReg())) {
+            acp.erase(cur);
+          }
+        }
+      }
+    }
+
+    if (isCopy(MI)) {
+      acp[MI.getOperand(0).getReg()] = MI.getOperand(1).getReg();
+    }
+  }
+
+  for (MachineInstr *MI : to_remove) {
+    MI->eraseFromParent();
+  }
+  return replaced;
+}
+
+/*
+ * globalPropagation numbers the copies, solves the copies available on
+ * entry to every reachable block, and propagates them through the block.
+ * Returns the number of uses replaced.
+ */
+unsigned int RegisterCopies::globalPropagation() {
+  DenseMap<MachineBasicBlock *, uint32_t> block_idx;
+  for (MachineBasicBlock *MBB : ReversePostOrderTraversal<MachineFunction *>(
+           &MF)) {
+    block_idx[MBB] = rpo.size();
+    rpo.push_back(MBB);
+  }
+  for (MachineBasicBlock *MBB : rpo) {
+    pred_begin.push_back(preds.size());
+    for (MachineBasicBlock *pred : MBB->predecessors()) {
+      auto it = block_idx.find(pred);
+      if (it != block_idx.end()) preds.push_back(it->second);
+    }
+  }
+  pred_begin.push_back(preds.size());
+
+  // the copies whose destination or source is a virtual register or
+  // overlaps a register unit, for finding what a definition kills
+  DenseMap<Register, std::vector<uint32_t>> by_vreg;
+  std::vector<std::vector<uint32_t>> by_unit(TRI.getNumRegUnits());
+  std::vector<uint32_t> physical;
+  // the copies of block b are copy_begin[b] up to copy_begin[b + 1]
+  std::vector<uint32_t> copy_begin;
+  for (MachineBasicBlock *MBB : rpo) {
+    copy_begin.push_back(copies.size());
+    for (MachineInstr &MI : *MBB) {
+      if (!isCopy(MI)) continue;
+      uint32_t id = copies.size();
+      copies.push_back(
+          {&MI, MI.getOperand(0).getReg(), MI.getOperand(1).getReg()});
+      for (Register reg : {copies.back().dst, copies.back().src}) {
+        if (reg.isVirtual()) {
+          by_vreg[reg].push_back(id);
+          continue;
+        }
+        for (MCRegUnitIterator unit(reg.asMCReg(), &TRI); unit.isValid();
+             ++unit) {
+          by_unit[*unit].push_back(id);
+        }
+      }
+      if (copies.back().dst.isPhysical()) physical.push_back(id);
+    }
+  }
+  copy_begin.push_back(copies.size());
+  if (copies.empty()) return 0;
+
+  BumpPtrAllocator arena;
+  uint32_t b, nr_blocks = rpo.size(), nr_copies = copies.size();
+  auto *blocks =
+      arena.Allocate<cpass::BasicBlockInfo<cpass::BitSet>>(nr_blocks);
+  for (b = 0; b < nr_blocks; b++) {
+    cpass::BasicBlockInfo<cpass::BitSet> &bbi = *new (&blocks[b])
+        cpass::BasicBlockInfo<cpass::BitSet>(arena, nr_copies);
+    auto kill = [&](uint32_t id) {
+      bbi.KILL.set(id);
+      bbi.COPY.reset(id);
+    };
+    uint32_t next = copy_begin[b];
+    for (MachineInstr &MI : *rpo[b]) {
+      for (MachineOperand &MO : MI.operands()) {
+        if (MO.isRegMask()) {
+          for (uint32_t id : physical) {
+            if (MO.clobbersPhysReg(copies[id].dst) ||
+                MO.clobbersPhysReg(copies[id].src)) {
+              kill(id);
+            }
+          }
+        } else if (MO.isReg() && MO.isDef() && MO.getReg()) {
+          Register reg = MO.getReg();
+          if (reg.isVirtual()) {
+            auto it = by_vreg.find(reg);
+            if (it != by_vreg.end()) {
+              for (uint32_t id : it->second) kill(id);
+            }
+            continue;
+          }
+          for (MCRegUnitIterator unit(reg.asMCReg(), &TRI); unit.isValid();
+               ++unit) {
+            for (uint32_t id : by_unit[*unit]) kill(id);
+          }
+        }
+      }
+      if (next < copy_begin[b + 1] && copies[next].mi == &MI) {
+        bbi.COPY.set(next++);
+      }
+    }
+  }
+  cpass::solveForward(blocks, pred_begin.data(), preds.data(), nr_blocks);
+
+  unsigned int replaced = 0;
+  for (b = 0; b < nr_blocks; b++) {
+    RegACPTable acp;
+    for (uint32_t id = 0; id < nr_copies; id++) {
+      if (blocks[b].CPIn.test(id)) acp[copies[id].dst] = copies[id].src;
+    }
+    if (!acp.empty()) replaced += propagateBlock(*rpo[b], acp, true);
+  }
+  return replaced;
+}
+
+/*
+ * removeDeadCopies removes the copies to virtual registers that are no
+ * longer used, which propagation leaves behind. Returns how many.
+ */
+unsigned int RegisterCopies::removeDeadCopies() {
+  std::vector<MachineInstr *> dead;
+  for (MachineBasicBlock &MBB : MF) {
+    for (MachineInstr &MI : MBB) {
+      if (MI.isCopy() && MI.getOperand(0).getReg().isVirtual() &&
+          MRI.use_empty(MI.getOperand(0).getReg())) {
+        dead.push_back(&MI);
+      }
+    }
+  }
+  for (MachineInstr *MI : dead) {
+    MI->eraseFromParent();
+  }
+  return dead.size();
+}
+
+/*
+ * clearKillFlags clears the kill flags of the registers put in place of
+ * others, which may now be read after them.
+ */
+void RegisterCopies::clearKillFlags() {
+  bool physical = false;
+  for (Register reg : sources) {
+    if (reg.isVirtual()) {
+      MRI.clearKillFlags(reg);
+    } else {
+      physical = true;
+    }
+  }
+  if (!physical) return;
+  for (MachineBasicBlock &MBB : MF) {
+    for (MachineInstr &MI : MBB) {
+      for (MachineOperand &MO : MI.operands()) {
+        if (!MO.isReg() || !MO.isUse() || !MO.isKill()) continue;
+        for (Register reg : sources) {
+          if (reg.isPhysical() && TRI.regsOverlap(reg, MO.getReg())) {
+            MO.setIsKill(false);
+            break;
+          }
+        }
+      }
+    }
+  }
+}
+
+/*
+ * addLiveIns adds to the live-in lists of the blocks the physical registers
+ * that are now read in blocks after the one that copied them, until no
+ * list grows.
+ */
+void RegisterCopies::addLiveIns() {
+  LivePhysRegs live;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (MachineBasicBlock *MBB : post_order(&MF)) {
+      // addLiveIn does not check for duplicates, so the list is rebuilt
+      std::vector<MachineBasicBlock::RegisterMaskPair> before(
+          MBB->livein_begin(), MBB->livein_end());
+      MBB->clearLiveIns();
+      computeAndAddLiveIns(live, *MBB);
+      MBB->sortUniqueLiveIns();
+      changed |= !equal(before.begin(), before.end(), MBB->livein_begin(),
+                        MBB->livein_end(),
+                        [](const MachineBasicBlock::RegisterMaskPair &a,
+                           const MachineBasicBlock::RegisterMaskPair &b) {
+                          return a.PhysReg == b.PhysReg &&
+                                 a.LaneMask == b.LaneMask;
+                        });
+    }
+  }
+}
+
+bool RegisterCopies::run(unsigned int &replaced, unsigned int &removed) {
+  unsigned int n = 0;
+  for (MachineBasicBlock &MBB : MF) {
+    RegACPTable acp;
+    n += propagateBlock(MBB, acp, false);
+  }
+  n += globalPropagation();
+  replaced += n;
+
+  unsigned int dead = removeDeadCopies();
+  removed += dead;
+  if (!n) return dead > 0;
+  clearKillFlags();
+  if (global_physical && MRI.tracksLiveness()) addLiveIns();
+  return true;
+}
+
+class MachineCopyPropagation : public MachineFunctionPass {
+ public:
+  static char ID;
+  static cl::opt<bool> mcp_stats;
+  unsigned int replaced = 0;
+  unsigned int removed = 0;
+  MachineCopyPropagation() : MachineFunctionPass(ID) {}
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.setPreservesCFG();
+    MachineFunctionPass::getAnalysisUsage(AU);
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override {
+    return RegisterCopies(MF).run(replaced, removed);
+  }
+
+  bool doFinalization(Module &M) override {
+    if (mcp_stats) {
+      errs() << "machine_copy_prop: " << replaced << " uses replaced, "
+             << removed << " copies removed\n";
+    }
+    replaced = removed = 0;
+    return false;
+  }
+};  // end MachineCopyPropagation
+}  // end anonymous namespace
+
+char MachineCopyPropagation::ID = 0;
+static RegisterPass<MachineCopyPropagation> X(
+    "machine_copy_prop", "machine register copy propagation",
+    false /* Only looks at CFG */, false /* Analysis Pass */);
+
+cl::opt<bool> MachineCopyPropagation::mcp_stats(
+    "mcp-stats", cl::desc("print the number of uses replaced and copies removed"),
+    cl::init(false));
@@ -0,0 +1,108 @@
+/*
+ * cpass-client: sends an IR file to a cpass-server and writes the optimized
+ * module as bitcode. The input may be bitcode or text; verbose output from
+ * the pass is written to stderr.
+ *
+ * usage: cpass-client [-socket=path] [-local] [-verbose] [-o output] input
+ *        cpass-client [-socket=path] -shutdown
+ */
+
+#include <unistd.h>
+
+#include <string>
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "protocol.h"
+
+using namespace llvm;
+using namespace std;
+
+static cl::opt<string> input_file(cl::Positional, cl::desc("<input file>"),
+                                  cl::init("-"));
+static cl::opt<string> output_file("o", cl::desc("output file"),
+                                   cl::value_desc("filename"), cl::init("-"));
+static cl::opt<string> socket_path("socket",
+                                   cl::desc("path of the server's socket"),
+                                   cl::init("cpass.sock"));
+static cl::opt<bool> local_only("local",
+                                cl::desc("run local copy propagation only"),
+                                cl::init(false));
+static cl::opt<bool> verbose("verbose", cl::desc("print the pass's output"),
+                             cl::init(false));
+static cl::opt<bool> stop_server("shutdown", cl::desc("stop the server"),
+                                 cl::init(false));
+
+static int fail(const Twine &msg) {
+  errs() << "cpass-client: " << msg << "\n";
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  InitLLVM init(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv, "copy_prop compile server client\n");
+
+  string error;
+  int fd = cpass::connectTo(socket_path, error);
+  if (fd < 0) {
+    return fail(error);
+  }
+
+  cpass::RequestHeader req;
+  req.magic = cpass::PROTOCOL_MAGIC;
+  req.kind = stop_server ? cpass::REQUEST_SHUTDOWN : cpass::REQUEST_PROPAGATE;
+  req.flags = (local_only ? 0 : cpass::FLAG_GLOBAL) |
+              (verbose ? cpass::FLAG_VERBOSE : 0);
+  req.reserved = 0;
+  req.payload_size = 0;
+
+  if (stop_server) {
+    if (!cpass::writeAll(fd, &req, sizeof(req))) {
+      return fail("cannot send request");
+    }
+    close(fd);
+    return 0;
+  }
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> input =
+      MemoryBuffer::getFileOrSTDIN(input_file);
+  if (!input) {
+    return fail("cannot read " + input_file + ": " +
+                input.getError().message());
+  }
+  StringRef payload = (*input)->getBuffer();
+  req.payload_size = payload.size();
+
+  cpass::ResponseHeader resp;
+  if (!cpass::writeAll(fd, &req, sizeof(req)) ||
+      !cpass::writeAll(fd, payload.data(), payload.size()) ||
+      !cpass::readAll(fd, &resp, sizeof(resp)) ||
+      resp.magic != cpass::PROTOCOL_MAGIC) {
+    return fail("lost connection to the server");
+  }
+  string module(resp.module_size, '\0'), log(resp.log_size, '\0');
+  if (!cpass::readAll(fd, &module[0], module.size()) ||
+      !cpass::readAll(fd, &log[0], log.size())) {
+    return fail("lost connection to the server");
+  }
+  close(fd);
+
+  errs() << log;
+  if (resp.status != cpass::STATUS_OK) {
+    return 1;
+  }
+
+  std::error_code ec;
+  ToolOutputFile out(output_file, ec, sys::fs::OF_None);
+  if (ec) {
+    return fail("cannot write " + output_file + ": " + ec.message());
+  }
+  out.os() << module;
+  out.keep();
+  return 0;
+}
@@ -0,0 +1,102 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+using namespace std;
+
+namespace cpass {
+
+bool readAll(int fd, void *buf, size_t size) {
+  char *p = (char *)buf;
+  while (size > 0) {
+    ssize_t n = read(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool writeAll(int fd, const void *buf, size_t size) {
+  const char *p = (const char *)buf;
+  while (size > 0) {
+    // MSG_NOSIGNAL: a client going away must not kill the server
+    ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+/* makeAddress fills addr for path, or sets error if path is too long */
+static bool makeAddress(const string &path, sockaddr_un &addr, string &error) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    error = "socket path too long: " + path;
+    return false;
+  }
+  strcpy(addr.sun_path, path.c_str());
+  return true;
+}
+
+int connectTo(const string &path, string &error) {
+  sockaddr_un addr;
+  if (!makeAddress(path, addr, error)) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    error = "cannot connect to " + path + ": " + strerror(errno);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+  return fd;
+}
+
+int listenOn(const string &path, string &error) {
+  sockaddr_un addr;
+  if (!makeAddress(path, addr, error)) {
+    return -1;
+  }
+
+  // a socket file nobody is listening on is left over from a dead server
+  string ignored;
+  int probe = connectTo(path, ignored);
+  if (probe >= 0) {
+    close(probe);
+    error = "a server is already listening on " + path;
+    return -1;
+  }
+  unlink(path.c_str());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(fd, SOMAXCONN) < 0) {
+    error = "cannot listen on " + path + ": " + strerror(errno);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+  return fd;
+}
+
+}  // namespace cpass
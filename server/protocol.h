@@ -0,0 +1,73 @@
+#ifndef CPASS_PROTOCOL_H
+#define CPASS_PROTOCOL_H
+
+#include <stdint.h>
+
+#include <string>
+
+/*
+ * Wire format shared by cpass-server and cpass-client.
+ *
+ * A client connects to the server's Unix socket and sends any number of
+ * requests, each a RequestHeader followed by payload_size bytes of IR
+ * (bitcode or text). The server answers each with a ResponseHeader followed
+ * by module_size bytes of bitcode and log_size bytes of text: the verbose
+ * output on success, or an error message on failure. Both ends are on the
+ * same machine, so integers are sent in host byte order.
+ */
+namespace cpass {
+
+const uint32_t PROTOCOL_MAGIC = 0x43505356;  // "CPSV"
+
+enum RequestKind : uint32_t {
+  REQUEST_PROPAGATE = 0,
+  // stop accepting connections and exit once running requests finish
+  REQUEST_SHUTDOWN = 1,
+};
+
+enum RequestFlags : uint32_t {
+  FLAG_GLOBAL = 1 << 0,
+  FLAG_VERBOSE = 1 << 1,
+};
+
+enum ResponseStatus : uint32_t {
+  STATUS_OK = 0,
+  STATUS_ERROR = 1,
+};
+
+// the largest payload a server accepts; larger requests get STATUS_ERROR
+const uint64_t MAX_PAYLOAD_SIZE = uint64_t(1) << 30;
+
+struct RequestHeader {
+  uint32_t magic;
+  uint32_t kind;
+  uint32_t flags;
+  uint32_t reserved;
+  uint64_t payload_size;
+};
+
+struct ResponseHeader {
+  uint32_t magic;
+  uint32_t status;
+  uint64_t module_size;
+  uint64_t log_size;
+};
+
+/*
+ * readAll and writeAll transfer exactly size bytes over fd, retrying short
+ * reads and writes. They return false on error or end of file.
+ */
+bool readAll(int fd, void *buf, size_t size);
+bool writeAll(int fd, const void *buf, size_t size);
+
+/*
+ * connectTo and listenOn open a stream socket at path. listenOn replaces a
+ * stale socket file left by a previous server. Both return -1 and set error
+ * on failure.
+ */
+int connectTo(const std::string &path, std::string &error);
+int listenOn(const std::string &path, std::string &error);
+
+}  // namespace cpass
+
+#endif  // CPASS_PROTOCOL_H
@@ -0,0 +1,234 @@
+/*
+ * cpass-server: runs copy_prop for clients connecting over a Unix socket.
+ *
+ * The server keeps LLVM and the pass loaded between requests, so a build can
+ * skip the opt startup, plugin loading and option parsing that each opt
+ * invocation pays for. Every connection is served on its own thread and every
+ * request is parsed into its own LLVMContext. See protocol.h for the wire
+ * format and cpass-client for a client.
+ *
+ * The server runs until it receives a shutdown request, SIGINT or SIGTERM,
+ * and removes its socket file when it exits. With -cache-dir, results are
+ * kept in a ResultCache shared by all connections.
+ *
+ * usage: cpass-server [-socket=path] [-cache-dir=dir] [-cache-size=MiB]
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "cpass.h"
+#include "protocol.h"
+#include "result_cache.h"
+
+using namespace llvm;
+using namespace std;
+
+static cl::opt<string> socket_path("socket", cl::desc("path of the socket"),
+                                   cl::init("cpass.sock"));
+static cl::opt<string> cache_dir("cache-dir",
+                                 cl::desc("reuse results cached in this "
+                                          "directory"),
+                                 cl::init(""));
+static cl::opt<unsigned> cache_size(
+    "cache-size", cl::desc("size limit of the result cache in MiB"),
+    cl::init(256));
+
+// shared by all connections; null without -cache-dir
+static cpass::ResultCache *cache = nullptr;
+
+static int listen_fd = -1;
+static atomic<bool> stopping(false);
+static atomic<unsigned> nr_requests(0);
+
+// requests being processed; shutdown waits for them to finish
+static mutex busy_lock;
+static condition_variable busy_done;
+static unsigned busy = 0;
+
+// copy of socket_path usable from the signal handler
+static char socket_file[108];
+
+static void onSignal(int) {
+  unlink(socket_file);
+  _exit(0);
+}
+
+/*
+ * runRequest parses payload as IR, runs copy propagation over every function
+ * it defines and returns the result as bitcode in module. Verbose output, or
+ * the error message on failure, goes to log. Returns false on failure.
+ */
+static bool runRequest(const cpass::RequestHeader &req, const string &payload,
+                       SmallVectorImpl<char> &module, string &log) {
+  raw_string_ostream log_os(log);
+  LLVMContext ctx;
+  SMDiagnostic err;
+  std::unique_ptr<Module> m = parseIR(
+      MemoryBufferRef(payload, "<request>"), err, ctx);
+  if (!m) {
+    err.print("cpass-server", log_os);
+    return false;
+  }
+
+  cpass::Options opts;
+  opts.global = req.flags & cpass::FLAG_GLOBAL;
+  opts.verbose = req.flags & cpass::FLAG_VERBOSE;
+  opts.log = &log_os;
+  opts.cache = cache;
+  for (Function &f : *m) {
+    if (!f.isDeclaration()) {
+      cpass::propagate(f, opts);
+    }
+  }
+
+  raw_svector_ostream os(module);
+  WriteBitcodeToFile(*m, os);
+  return true;
+}
+
+/* beginShutdown makes the accept loop in main return */
+static void beginShutdown() {
+  if (!stopping.exchange(true)) {
+    shutdown(listen_fd, SHUT_RDWR);
+  }
+}
+
+/* endRequest marks a request counted in busy as finished */
+static void endRequest() {
+  {
+    lock_guard<mutex> guard(busy_lock);
+    busy--;
+  }
+  busy_done.notify_all();
+}
+
+/* sendResponse sends a response header, module and log to fd */
+static bool sendResponse(int fd, bool ok, const SmallVectorImpl<char> &module,
+                         const string &log) {
+  cpass::ResponseHeader resp;
+  resp.magic = cpass::PROTOCOL_MAGIC;
+  resp.status = ok ? cpass::STATUS_OK : cpass::STATUS_ERROR;
+  resp.module_size = module.size();
+  resp.log_size = log.size();
+  return cpass::writeAll(fd, &resp, sizeof(resp)) &&
+         cpass::writeAll(fd, module.data(), module.size()) &&
+         cpass::writeAll(fd, log.data(), log.size());
+}
+
+/*
+ * serveConnection answers requests on fd until the client disconnects, sends
+ * something that is not a request, or the server shuts down.
+ */
+static void serveConnection(int fd) {
+  cpass::RequestHeader req;
+  while (!stopping && cpass::readAll(fd, &req, sizeof(req)) &&
+         req.magic == cpass::PROTOCOL_MAGIC) {
+    if (req.kind == cpass::REQUEST_SHUTDOWN) {
+      beginShutdown();
+      break;
+    }
+
+    // counted before checking for shutdown, so that shutdown either waits
+    // for the request or the request sees it
+    {
+      lock_guard<mutex> guard(busy_lock);
+      busy++;
+    }
+    if (stopping) {
+      endRequest();
+      break;
+    }
+
+    SmallVector<char, 0> module;
+    string log;
+    if (req.payload_size > cpass::MAX_PAYLOAD_SIZE) {
+      // the payload is not read, so the connection cannot go on
+      log = "cpass-server: payload of " + to_string(req.payload_size) +
+            " bytes exceeds the limit of " +
+            to_string(cpass::MAX_PAYLOAD_SIZE) + "\n";
+      sendResponse(fd, false, module, log);
+      endRequest();
+      break;
+    }
+
+    string payload(req.payload_size, '\0');
+    bool sent = false;
+    if (cpass::readAll(fd, &payload[0], payload.size())) {
+      bool ok = runRequest(req, payload, module, log);
+      nr_requests++;
+      sent = sendResponse(fd, ok, module, log);
+    }
+    endRequest();
+    if (!sent) {
+      break;
+    }
+  }
+  close(fd);
+}
+
+int main(int argc, char **argv) {
+  InitLLVM init(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv, "copy_prop compile server\n");
+
+  std::unique_ptr<cpass::ResultCache> result_cache;
+  if (!cache_dir.empty()) {
+    result_cache.reset(
+        new cpass::ResultCache(cache_dir, (uint64_t)cache_size << 20));
+    cache = result_cache.get();
+  }
+
+  string error;
+  listen_fd = cpass::listenOn(socket_path, error);
+  if (listen_fd < 0) {
+    errs() << "cpass-server: " << error << "\n";
+    return 1;
+  }
+  strncpy(socket_file, socket_path.c_str(), sizeof(socket_file) - 1);
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  while (!stopping) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    thread(serveConnection, fd).detach();
+  }
+
+  // idle connections are dropped when the process exits
+  {
+    unique_lock<mutex> guard(busy_lock);
+    busy_done.wait(guard, []() { return busy == 0; });
+  }
+  close(listen_fd);
+  unlink(socket_path.c_str());
+  errs() << "cpass-server: served " << nr_requests << " requests\n";
+  if (cache) {
+    cache->printStats(errs());
+  }
+  return 0;
+}
@@ -1,36 +1,179 @@
 #!/bin/bash
+#
+# Regression runner. By default it runs the lit tests (the check-cpass
+# target), which compare the pass against expected output checked in under
+# test/.
+#
+# With -r it instead compiles every input in $INPUT_DIR, runs it through the
+# reference and test plugins and compares both the optimized IR and the
+# verbose (stderr) output. The pass removes more than the reference plugin
+# (redundant stores, memset and memcpy copies), so inputs that exercise that
+# are reported as differing; use it to inspect those differences.
+#
+# In -r mode tests run in parallel, each in its own scratch directory under
+# $WORK_DIR. Plugin outputs are cached in $CACHE_DIR keyed by a hash of the
+# input source, the plugin binary and the toolchain, so only tests whose
+# inputs changed are rerun.
+#
+# usage: ./test.sh [-j jobs] [-f] [-r] [test ...]
+#   -j jobs  number of tests to run at once (default: nproc)
+#   -f       ignore the cache and rerun everything (-r only)
+#   -r       compare against the reference plugin instead of running lit
+#   test     run only the named tests (e.g. ex1 simple, or verbose for lit)
+
+# a pipeline fails if any command in it does, so an opt crash is not hidden
+# behind llvm-dis and its partial output is never cached
+set -o pipefail
 
 INPUT_DIR="./inputs"
+WORK_DIR="./.test_work"
+CACHE_DIR="./.test_cache"
+REF_PLUGIN="ref_builds/lib_ref_copy_prop.so"
+TEST_PLUGIN="build/copy_prop/libcopy_prop.so"
+JOBS=$(nproc)
+FORCE=0
+REFERENCE=0
+
+while getopts "j:fr" opt
+do
+  case $opt in
+    j) JOBS=$OPTARG ;;
+    f) FORCE=1 ;;
+    r) REFERENCE=1 ;;
+    *) echo "usage: ./test.sh [-j jobs] [-f] [-r] [test ...]"; exit 2 ;;
+  esac
+done
+shift $((OPTIND - 1))
+
+if [ $REFERENCE == 0 ]; then
+  if [ ! -f build/CMakeCache.txt ]; then
+    echo "missing build (run ./build.sh)"
+    exit 2
+  fi
+  LIT_OPTS="-j $JOBS"
+  if [ $# -gt 0 ]; then
+    # lit matches the filter against test names such as cpass :: verbose.ll
+    FILTER=`echo "$@" | tr ' ' '|'`
+    LIT_OPTS="$LIT_OPTS --filter=($FILTER)"
+  fi
+  export LIT_OPTS
+  cmake --build build --target check-cpass
+  exit
+fi
+
+for PLUGIN in $REF_PLUGIN $TEST_PLUGIN
+do
+  if [ ! -f "$PLUGIN" ]; then
+    echo "missing $PLUGIN (run ./build.sh for the test plugin)"
+    exit 2
+  fi
+done
+
+# anything that changes the generated IR must be part of the cache key
+TOOLCHAIN_HASH=`{ clang --version; opt --version; } | sha256sum | cut -d' ' -f1`
+REF_HASH=`sha256sum $REF_PLUGIN | cut -d' ' -f1`
+TEST_HASH=`sha256sum $TEST_PLUGIN | cut -d' ' -f1`
+
+mkdir -p $CACHE_DIR/REF $CACHE_DIR/TEST llvm_ir/ref llvm_ir/test llvm_ir/unoptimized
+
+# run_plugin KIND PLUGIN_HASH PLUGIN TESTNAME
+#
+# Produces $WORK_DIR/TESTNAME/KIND.ll and KIND.err, either from the cache or by
+# running opt with PLUGIN. Cache entries are written to a temporary name and
+# moved into place so concurrent runners never see partial files.
+run_plugin() {
+  local kind=$1 plugin_hash=$2 plugin=$3 testname=$4
+  local work="$WORK_DIR/$testname"
+  local key=`cat "$INPUT_DIR/$testname.c" | sha256sum | cut -d' ' -f1`
+  key=`echo "$key $plugin_hash $TOOLCHAIN_HASH" | sha256sum | cut -d' ' -f1`
+  local entry="$CACHE_DIR/$kind/$key"
+
+  if [ $FORCE == 0 ] && [ -f "$entry.ll" ] && [ -f "$entry.err" ]; then
+    cp "$entry.ll" "$work/$kind.ll"
+    cp "$entry.err" "$work/$kind.err"
+    return 0
+  fi
+
+  if [ ! -f "$work/unoptimized.ll" ]; then
+    clang -O0 -S -emit-llvm "$INPUT_DIR/$testname.c" -o "$work/unoptimized.ll" \
+      2> "$work/clang.err" || return 1
+  fi
+  opt -O0 -enable-new-pm=0 -load "$plugin" -copy_prop -verbose \
+    < "$work/unoptimized.ll" 2> "$work/$kind.err" \
+    | llvm-dis -o "$work/$kind.ll" || return 1
+
+  cp "$work/$kind.ll" "$entry.ll.$$"
+  cp "$work/$kind.err" "$entry.err.$$"
+  mv "$entry.ll.$$" "$entry.ll"
+  mv "$entry.err.$$" "$entry.err"
+}
+
+# run_test TESTNAME
+#
+# Runs a single test in its scratch directory and records the outcome in
+# $WORK_DIR/TESTNAME/result for the report.
+run_test() {
+  local testname=$1
+  local work="$WORK_DIR/$testname"
+  rm -rf "$work"
+  mkdir -p "$work"
+
+  if ! run_plugin REF $REF_HASH $REF_PLUGIN $testname ||
+     ! run_plugin TEST $TEST_HASH $TEST_PLUGIN $testname; then
+    echo "Running $testname failed, see $work for the logs" > "$work/result"
+    return
+  fi
+
+  # keep the usual locations up to date for manual inspection
+  cp "$work/REF.ll" "llvm_ir/ref/$testname.ll"
+  cp "$work/TEST.ll" "llvm_ir/test/$testname.ll"
+  if [ -f "$work/unoptimized.ll" ]; then
+    cp "$work/unoptimized.ll" "llvm_ir/unoptimized/$testname.ll"
+  fi
+
+  if ! diff -q "$work/REF.ll" "$work/TEST.ll" > /dev/null; then
+    echo "Output for $testname differs, run diff -y $work/REF.ll $work/TEST.ll to see how they differ" > "$work/result"
+  elif ! diff -q "$work/REF.err" "$work/TEST.err" > /dev/null; then
+    echo "Error for $testname differs, run diff -y $work/REF.err $work/TEST.err to see how they differ" > "$work/result"
+  else
+    echo "PASS" > "$work/result"
+  fi
+}
+
+if [ $# -gt 0 ]; then
+  TESTS="$@"
+else
+  TESTS=""
+  for FILE in $INPUT_DIR/*.c
+  do
+    testname=`basename $FILE`
+    TESTS="$TESTS ${testname%.*}"
+  done
+fi
+
+for testname in $TESTS
+do
+  while [ `jobs -rp | wc -l` -ge $JOBS ]
+  do
+    wait -n
+  done
+  run_test $testname &
+done
+wait
+
 NUM_CORR=0
 NUM_TOTAL=0
-CORRECT_ERR="correct.err"
-TEST_ERR="test.err"
-
-for FILE in $INPUT_DIR/*
+for testname in $TESTS
 do
   ((NUM_TOTAL++))
-  testname=`basename $FILE`
-  testname=${testname%.*}
-  ./run_opt.sh TEST --opt $testname 2> $TEST_ERR
-  ./run_opt.sh REF --opt $testname 2> $CORRECT_ERR
-  CORRECT_OUTPUT="llvm_ir/ref/$testname.ll"
-  TEST_OUTPUT="llvm_ir/test/$testname.ll"
-  DIFF=`diff $CORRECT_OUTPUT $TEST_OUTPUT`
-  DIFF_ERR=`diff $CORRECT_ERR $TEST_ERR`
-  if [ "$DIFF" != "" ]; then
-    echo "Output for $testname differs, run diff -y $CORRECT_OUTPUT $TEST_OUTPUT to see how they differ"
-    echo "$NUM_CORR/$NUM_TOTAL correct"
-    # exit 1
-  elif [ "$DIFF_ERR" != "" ]; then
-    echo "Error for $testname differs, run diff -y $CORRECT_ERR $TEST_ERR to see how they differ"
-    echo "$NUM_CORR/$NUM_TOTAL correct"
-    exit 1
-  else
+  RESULT=`cat "$WORK_DIR/$testname/result" 2> /dev/null`
+  if [ "$RESULT" == "PASS" ]; then
     echo "$testname is correct"
     ((NUM_CORR++))
+  else
+    echo "${RESULT:-No result for $testname}"
   fi
 done
 
 echo "$NUM_CORR/$NUM_TOTAL correct"
-echo "cleaning up..."
-rm $CORRECT_ERR $TEST_ERR
+[ $NUM_CORR == $NUM_TOTAL ]
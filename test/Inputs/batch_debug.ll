@@ -0,0 +1,32 @@
+; Two functions and a global with debug info, for the -split case in batch.ll
+@g = global i32 7, !dbg !10
+
+define i32 @a(i32 %v) !dbg !4 {
+  %p = alloca i32, align 4
+  store i32 %v, i32* %p, align 4, !dbg !7
+  %r = load i32, i32* %p, align 4, !dbg !7
+  ret i32 %r, !dbg !7
+}
+
+define i32 @b() !dbg !8 {
+  %r = load i32, i32* @g, align 4, !dbg !9
+  ret i32 %r, !dbg !9
+}
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!3}
+!llvm.ident = !{!13}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C99, file: !1, producer: "cc", isOptimized: false, runtimeVersion: 0, emissionKind: FullDebug, globals: !12)
+!1 = !DIFile(filename: "d.c", directory: "/tmp")
+!2 = !DISubroutineType(types: !{})
+!3 = !{i32 2, !"Debug Info Version", i32 3}
+!4 = distinct !DISubprogram(name: "a", scope: !1, file: !1, line: 1, type: !2, spFlags: DISPFlagDefinition, unit: !0)
+!7 = !DILocation(line: 1, scope: !4)
+!8 = distinct !DISubprogram(name: "b", scope: !1, file: !1, line: 2, type: !2, spFlags: DISPFlagDefinition, unit: !0)
+!9 = !DILocation(line: 2, scope: !8)
+!10 = !DIGlobalVariableExpression(var: !11, expr: !DIExpression())
+!11 = distinct !DIGlobalVariable(name: "g", scope: !0, file: !1, line: 3, type: !14, isLocal: false, isDefinition: true)
+!12 = !{!10}
+!13 = !{!"cc"}
+!14 = !DIBasicType(name: "int", size: 32, encoding: DW_ATE_signed)
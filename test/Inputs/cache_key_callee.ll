@@ -0,0 +1,15 @@
+; @callee_attrs of cache_key.ll with its callee declared readnone
+target datalayout = "e-i64:64"
+
+declare void @llvm.memset.p0i8.i64(i8* nocapture writeonly, i8, i64, i1 immarg)
+declare void @h2() readnone
+
+define i8 @callee_attrs(i8 %x) {
+entry:
+  %a = alloca [4 x i8], align 4
+  %p = getelementptr inbounds [4 x i8], [4 x i8]* %a, i64 0, i64 0
+  call void @llvm.memset.p0i8.i64(i8* align 4 %p, i8 %x, i64 4, i1 false)
+  call void @h2()
+  %v = load i8, i8* %p, align 1
+  ret i8 %v
+}
@@ -0,0 +1,17 @@
+; @layout of cache_key.ll under a layout that aligns i64 to 4 bytes
+target datalayout = "e-i64:32"
+
+%pair = type { i32, i64 }
+
+declare void @llvm.memset.p0i8.i64(i8* nocapture writeonly, i8, i64, i1 immarg)
+
+define i64 @layout() {
+entry:
+  %s = alloca %pair, align 8
+  %b = getelementptr inbounds %pair, %pair* %s, i32 0, i32 1
+  store i64 7, i64* %b, align 4
+  %0 = bitcast %pair* %s to i8*
+  call void @llvm.memset.p0i8.i64(i8* align 8 %0, i8 0, i64 8, i1 false)
+  %1 = load i64, i64* %b, align 4
+  ret i64 %1
+}
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+"""
+Generates a function made of a long chain of conditional blocks, in the style
+of clang -O0 output, for stress testing the global phase.
+
+Each link loads the loop-invariant %inv and the accumulator %acc, and
+conditionally stores a new value into %acc on a side block:
+
+  link<i>:
+    %inv<i> = load i32, i32* %inv     ; always available: removed
+    %acc<i> = load i32, i32* %acc     ; killed on the side path: kept
+    %sum<i> = add nsw i32 %acc<i>, %inv<i>
+    br i1 %c<i>, label %side<i>, label %link<i+1>
+  side<i>:
+    store i32 %sum<i>, i32* %acc
+    br label %link<i+1>
+
+Only the first link can see the copy of %acc made in the entry block, so
+the pass should leave one load of %acc in every later link (including the
+final one) and none of %inv.
+
+usage: gen_branch_chain.py <links>
+"""
+
+import sys
+
+
+def main():
+    links = int(sys.argv[1])
+    out = []
+    out.append("define i32 @branch_chain(i32 %n) {")
+    out.append("entry:")
+    out.append("  %inv = alloca i32, align 4")
+    out.append("  %acc = alloca i32, align 4")
+    out.append("  store i32 42, i32* %inv, align 4")
+    out.append("  store i32 0, i32* %acc, align 4")
+    out.append("  br label %link0")
+    for i in range(links):
+        out.append("")
+        out.append("link{}:".format(i))
+        out.append("  %inv{0} = load i32, i32* %inv, align 4".format(i))
+        out.append("  %acc{0} = load i32, i32* %acc, align 4".format(i))
+        out.append("  %sum{0} = add nsw i32 %acc{0}, %inv{0}".format(i))
+        out.append("  %c{0} = icmp slt i32 %sum{0}, %n".format(i))
+        out.append("  br i1 %c{0}, label %side{0}, label %link{1}".format(
+            i, i + 1))
+        out.append("")
+        out.append("side{}:".format(i))
+        out.append("  store i32 %sum{0}, i32* %acc, align 4".format(i))
+        out.append("  br label %link{}".format(i + 1))
+    out.append("")
+    out.append("link{}:".format(links))
+    out.append("  %ret = load i32, i32* %acc, align 4")
+    out.append("  ret i32 %ret")
+    out.append("}")
+    print("\n".join(out))
+
+
+if __name__ == "__main__":
+    main()
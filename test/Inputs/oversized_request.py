@@ -0,0 +1,33 @@
+#!/usr/bin/env python3
+"""
+Sends cpass-server a request whose header claims a payload larger than the
+server accepts, and prints the status and log of the response.
+
+usage: oversized_request.py <socket>
+"""
+
+import socket
+import struct
+import sys
+
+MAGIC = 0x43505356
+
+
+def main():
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(sys.argv[1])
+    sock.sendall(struct.pack("=IIIIQ", MAGIC, 0, 0, 0, 1 << 62))
+    resp = b""
+    while True:
+        data = sock.recv(4096)
+        if not data:
+            break
+        resp += data
+    magic, status, module_size, log_size = struct.unpack("=IIQQ", resp[:24])
+    log = resp[24 + module_size:24 + module_size + log_size]
+    print("status %d" % status)
+    sys.stdout.write(log.decode())
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,45 @@
+#!/usr/bin/env python3
+"""
+Runs a shell command while a cpass-server is listening on a socket.
+
+The server is started first and the command runs once the socket exists.
+If the command leaves the server running it is terminated; otherwise its
+stderr (which ends with the number of requests served) is copied to ours.
+Exits with the status of the command.
+
+usage: with_server.py <cpass-server> <socket> <command>
+"""
+
+import os
+import subprocess
+import sys
+import time
+
+
+def main():
+    server, socket, command = sys.argv[1:4]
+    if os.path.exists(socket):
+        os.unlink(socket)
+
+    proc = subprocess.Popen([server, "-socket=" + socket],
+                            stderr=subprocess.PIPE)
+    deadline = time.time() + 10
+    while not os.path.exists(socket):
+        if proc.poll() is not None or time.time() > deadline:
+            sys.stderr.write(proc.communicate()[1].decode())
+            sys.exit("with_server.py: server did not start")
+        time.sleep(0.01)
+
+    status = subprocess.call(command, shell=True)
+
+    try:
+        _, err = proc.communicate(timeout=10)
+        sys.stderr.write(err.decode())
+    except subprocess.TimeoutExpired:
+        proc.terminate()
+        proc.wait()
+    sys.exit(status)
+
+
+if __name__ == "__main__":
+    main()
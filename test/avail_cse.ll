@@ -0,0 +1,140 @@
+; avail_cse removes expressions already evaluated on every path to them.
+; RUN: %avail-cse -S < %s | FileCheck %s
+; RUN: %avail-cse -cse-stats -disable-output < %s 2>&1 \
+; RUN:   | FileCheck --check-prefix=STATS %s
+
+; STATS: avail_cse: 8 expressions removed
+
+; Twice in one block.
+; CHECK-LABEL: define i32 @local(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    %x = add nsw i32 %a, %b
+; CHECK-NEXT:    %r = mul i32 %x, %x
+; CHECK-NEXT:    ret i32 %r
+define i32 @local(i32 %a, i32 %b) {
+entry:
+  %x = add nsw i32 %a, %b
+  %y = add nsw i32 %a, %b
+  %r = mul i32 %x, %y
+  ret i32 %r
+}
+
+; Evaluated in a block that dominates the recomputation.
+; CHECK-LABEL: define i1 @dominated(
+; CHECK:       then:
+; CHECK-NEXT:    ret i1 %c
+; CHECK:       else:
+; CHECK-NEXT:    ret i1 %c
+define i1 @dominated(i32 %a, i32 %b) {
+entry:
+  %c = icmp slt i32 %a, %b
+  br i1 %c, label %then, label %else
+
+then:
+  %c1 = icmp slt i32 %a, %b
+  ret i1 %c1
+
+else:
+  %c2 = icmp slt i32 %a, %b
+  ret i1 %c2
+}
+
+; Evaluated in both arms of a branch: the join takes a phi of them.
+; CHECK-LABEL: define i32* @both_arms(
+; CHECK:       then:
+; CHECK-NEXT:    %p1 = getelementptr inbounds i32, i32* %base, i64 %i
+; CHECK:       else:
+; CHECK-NEXT:    %p2 = getelementptr inbounds i32, i32* %base, i64 %i
+; CHECK:       join:
+; CHECK-NEXT:    [[P:%.*]] = phi i32* [ %p2, %else ], [ %p1, %then ]
+; CHECK-NEXT:    ret i32* [[P]]
+define i32* @both_arms(i32* %base, i64 %i, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %p1 = getelementptr inbounds i32, i32* %base, i64 %i
+  store i32 1, i32* %p1, align 4
+  br label %join
+
+else:
+  %p2 = getelementptr inbounds i32, i32* %base, i64 %i
+  store i32 2, i32* %p2, align 4
+  br label %join
+
+join:
+  %p3 = getelementptr inbounds i32, i32* %base, i64 %i
+  ret i32* %p3
+}
+
+; Evaluated in one arm only, or with other flags: kept.
+; CHECK-LABEL: define i32 @one_arm(
+; CHECK:       join:
+; CHECK-NEXT:    %y = sub i32 %a, %b
+; CHECK-NEXT:    %z = sub nsw i32 %a, %b
+define i32 @one_arm(i32 %a, i32 %b, i1 %c) {
+entry:
+  br i1 %c, label %then, label %join
+
+then:
+  %x = sub i32 %a, %b
+  br label %join
+
+join:
+  %y = sub i32 %a, %b
+  %z = sub nsw i32 %a, %b
+  %r = add i32 %y, %z
+  ret i32 %r
+}
+
+; Around a loop: the invariant expression evaluated before the loop is
+; available in the header along both edges, and the body's evaluation of
+; the induction expression is redundant with the header's.
+; CHECK-LABEL: define i32 @loop(
+; CHECK:       header:
+; CHECK-NEXT:    %i = phi i32 [ 0, %entry ], [ %i.next, %body ]
+; CHECK-NEXT:    %cmp = icmp slt i32 %i, %n.inv
+; CHECK-NEXT:    %i.next = add i32 %i, 1
+; CHECK-NEXT:    br i1 %cmp, label %body, label %exit
+; CHECK:       body:
+; CHECK-NEXT:    br label %header
+; CHECK:       exit:
+; CHECK-NEXT:    ret i32 %i.next
+define i32 @loop(i32 %n) {
+entry:
+  %n.inv = mul i32 %n, 3
+  br label %header
+
+header:
+  %i = phi i32 [ 0, %entry ], [ %i.next2, %body ]
+  %n.again = mul i32 %n, 3
+  %cmp = icmp slt i32 %i, %n.again
+  %i.next = add i32 %i, 1
+  br i1 %cmp, label %body, label %exit
+
+body:
+  %i.next2 = add i32 %i, 1
+  br label %header
+
+exit:
+  %r = add i32 %i, 1
+  ret i32 %r
+}
+
+; A join reached from a block that is never executed.
+; CHECK-LABEL: define i32 @unreachable_pred(
+; CHECK:       join:
+; CHECK-NEXT:    %r = add i32 %x, %x
+define i32 @unreachable_pred(i32 %a) {
+entry:
+  %x = xor i32 %a, 5
+  br label %join
+
+dead:
+  br label %join
+
+join:
+  %y = xor i32 %a, 5
+  %r = add i32 %x, %y
+  ret i32 %r
+}
@@ -0,0 +1,72 @@
+; cpass-batch streams lazily loaded bitcode through the pass one function at
+; a time, and also accepts textual IR.
+; RUN: llvm-as < %s > %t.bc
+; RUN: %cpass-batch %t.bc -o %t.ll
+; RUN: FileCheck %s < %t.ll
+; RUN: %cpass-batch -local < %s | FileCheck %s --check-prefix=LOCAL
+; RUN: %cpass -S < %s | FileCheck %s
+; -split keeps symbols, linkage and order when relinking the partitions.
+; RUN: %cpass-batch -split=3 -workers=2 %t.bc | FileCheck %s
+; Every partition carries a copy of the compile unit; the relinked module
+; refers to one of them only.
+; RUN: llvm-as < %S/Inputs/batch_debug.ll > %t.debug.bc
+; RUN: %cpass-batch -split=3 %t.debug.bc -o %t.debug.ll
+; RUN: opt -verify -disable-output %t.debug.ll
+; RUN: FileCheck %s --check-prefix=DEBUG < %t.debug.ll
+; DEBUG:     !llvm.dbg.cu = !{![[CU:[0-9]+]]}
+; DEBUG:     ![[CU]] = distinct !DICompileUnit(
+; DEBUG-NOT: DICompileUnit(
+; DEBUG:     distinct !DISubprogram(name: "a",{{.*}} unit: ![[CU]])
+; DEBUG-NOT: DICompileUnit(
+; DEBUG:     distinct !DISubprogram(name: "b",{{.*}} unit: ![[CU]])
+
+; CHECK: @g = global i32 7
+@g = global i32 7
+
+; CHECK-LABEL: define i32 @diamond(
+; CHECK:       join:
+; CHECK-NEXT:    ret i32 5
+; LOCAL-LABEL: define i32 @diamond(
+; LOCAL:       join:
+; LOCAL-NEXT:    %0 = load i32, i32* %x, align 4
+define i32 @diamond(i1 %c) {
+entry:
+  %x = alloca i32, align 4
+  store i32 5, i32* %x, align 4
+  br i1 %c, label %then, label %join
+
+then:
+  br label %join
+
+join:
+  %0 = load i32, i32* %x, align 4
+  ret i32 %0
+}
+
+; CHECK-LABEL: define internal i32 @helper(
+; CHECK-NEXT:    %p = alloca i32, align 4
+; CHECK-NEXT:    store i32 %v, i32* %p, align 4
+; CHECK-NEXT:    ret i32 %v
+define internal i32 @helper(i32 %v) {
+  %p = alloca i32, align 4
+  store i32 %v, i32* %p, align 4
+  %l = load i32, i32* %p, align 4
+  ret i32 %l
+}
+
+; calls to a function whose body has already been written and released
+; CHECK-LABEL: define i32 @caller(
+; CHECK-NEXT:    %r = call i32 @diamond(i1 true)
+; CHECK-NEXT:    %h = call i32 @helper(i32 %r)
+; CHECK-NEXT:    store i32 %h, i32* @g, align 4
+; CHECK-NEXT:    ret i32 %h
+define i32 @caller() {
+  %r = call i32 @diamond(i1 true)
+  %h = call i32 @helper(i32 %r)
+  store i32 %h, i32* @g, align 4
+  %v = load i32, i32* @g, align 4
+  ret i32 %v
+}
+
+; CHECK: declare void @external()
+declare void @external()
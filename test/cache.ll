@@ -0,0 +1,60 @@
+; A second run with -cache-dir replays the cached results and gives the same
+; output as the first run and as a run without the cache.
+; RUN: rm -rf %t.cache
+; RUN: %cpass -S < %s > %t.ref
+; RUN: %cpass -cache-dir=%t.cache -cache-stats -S < %s > %t.first 2> %t.stats
+; RUN: %cpass -cache-dir=%t.cache -cache-stats -S < %s > %t.second 2>> %t.stats
+; RUN: diff %t.ref %t.first
+; RUN: diff %t.ref %t.second
+; RUN: FileCheck %s < %t.second
+; RUN: FileCheck %s --check-prefix=STATS < %t.stats
+; A size limit of zero evicts the two entries when the cache is opened, and
+; every new entry as soon as it is stored.
+; RUN: %cpass -cache-dir=%t.cache -cache-size=0 -cache-stats \
+; RUN:   -disable-output < %s 2>&1 | FileCheck %s --check-prefix=EVICT
+
+; @same_shape hits the entry stored for @diamond in the first run
+; STATS: cpass cache: 3 lookups, 1 hits (33.3%), 2 stores, 0 evictions
+; STATS: cpass cache: 3 lookups, 3 hits (100.0%), 0 stores, 0 evictions
+; EVICT: cpass cache: 3 lookups, 0 hits (0.0%), 3 stores, 5 evictions, 0 bytes
+
+; CHECK-LABEL: define i32 @diamond(
+; CHECK:       join:
+; CHECK-NEXT:    ret i32 5
+define i32 @diamond(i1 %c) {
+entry:
+  %x = alloca i32, align 4
+  store i32 5, i32* %x, align 4
+  br i1 %c, label %then, label %join
+
+then:
+  br label %join
+
+join:
+  %0 = load i32, i32* %x, align 4
+  ret i32 %0
+}
+
+; @same_shape differs from @diamond only in names
+; CHECK-LABEL: define i32 @same_shape(
+; CHECK:       done:
+; CHECK-NEXT:    ret i32 5
+define i32 @same_shape(i1 %flag) {
+start:
+  %y = alloca i32, align 4
+  store i32 5, i32* %y, align 4
+  br i1 %flag, label %other, label %done
+
+other:
+  br label %done
+
+done:
+  %v = load i32, i32* %y, align 4
+  ret i32 %v
+}
+
+; CHECK-LABEL: define void @unchanged(
+; CHECK-NEXT:    ret void
+define void @unchanged() {
+  ret void
+}
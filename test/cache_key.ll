@@ -0,0 +1,114 @@
+; The cache key covers what the pass reads besides the instructions and their
+; operands, so functions that differ only in it do not share an entry:
+; volatility, the data layout and the memory attributes of calls.
+; RUN: rm -rf %t.cache
+; RUN: %cpass -cache-dir=%t.cache -S < %s | FileCheck %s
+; RUN: %cpass -cache-dir=%t.cache -S < %s | FileCheck %s
+; RUN: %cpass -cache-dir=%t.cache -S < %S/Inputs/cache_key_layout.ll \
+; RUN:   | FileCheck %s --check-prefix=LAYOUT
+; RUN: %cpass -cache-dir=%t.cache -cache-stats -S \
+; RUN:   < %S/Inputs/cache_key_callee.ll 2> %t.stats \
+; RUN:   | FileCheck %s --check-prefix=CALLEE
+; RUN: FileCheck %s --check-prefix=CALLEE-STATS < %t.stats
+
+target datalayout = "e-i64:64"
+
+%pair = type { i32, i64 }
+
+declare void @llvm.memset.p0i8.i64(i8* nocapture writeonly, i8, i64, i1 immarg)
+declare void @h()
+declare void @h2()
+
+; @g must not replay the entry of @f, which removes the second store
+; CHECK-LABEL: define void @f(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    %p = alloca i32, align 4
+; CHECK-NEXT:    store i32 1, i32* %p, align 4
+; CHECK-NEXT:    ret void
+define void @f() {
+entry:
+  %p = alloca i32, align 4
+  store i32 1, i32* %p, align 4
+  store i32 1, i32* %p, align 4
+  ret void
+}
+
+; CHECK-LABEL: define void @g(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    %p = alloca i32, align 4
+; CHECK-NEXT:    store i32 1, i32* %p, align 4
+; CHECK-NEXT:    store volatile i32 1, i32* %p, align 4
+; CHECK-NEXT:    ret void
+define void @g() {
+entry:
+  %p = alloca i32, align 4
+  store i32 1, i32* %p, align 4
+  store volatile i32 1, i32* %p, align 4
+  ret void
+}
+
+; The memset stops short of field b under this layout, so the store still
+; holds. Inputs/cache_key_layout.ll has the same function under a layout
+; that places b within the memset.
+; CHECK-LABEL: define i64 @layout(
+; CHECK:         ret i64 7
+; LAYOUT-LABEL: define i64 @layout(
+; LAYOUT:         %1 = load i64, i64* %b, align 4
+; LAYOUT-NEXT:    ret i64 %1
+define i64 @layout() {
+entry:
+  %s = alloca %pair, align 8
+  %b = getelementptr inbounds %pair, %pair* %s, i32 0, i32 1
+  store i64 7, i64* %b, align 4
+  %0 = bitcast %pair* %s to i8*
+  call void @llvm.memset.p0i8.i64(i8* align 8 %0, i8 0, i64 8, i1 false)
+  %1 = load i64, i64* %b, align 4
+  ret i64 %1
+}
+
+; A call that may write memory kills the memset, one that may not leaves it
+; available; here only the attributes of the call site tell them apart.
+; CHECK-LABEL: define i8 @call_site_readnone(
+; CHECK-NOT:     load
+; CHECK:         ret i8 %x
+define i8 @call_site_readnone(i8 %x) {
+entry:
+  %a = alloca [4 x i8], align 4
+  %p = getelementptr inbounds [4 x i8], [4 x i8]* %a, i64 0, i64 0
+  call void @llvm.memset.p0i8.i64(i8* align 4 %p, i8 %x, i64 4, i1 false)
+  call void @h() readnone
+  %v = load i8, i8* %p, align 1
+  ret i8 %v
+}
+
+; CHECK-LABEL: define i8 @call_site_writes(
+; CHECK:         %v = load i8, i8* %p, align 1
+; CHECK-NEXT:    ret i8 %v
+define i8 @call_site_writes(i8 %x) {
+entry:
+  %a = alloca [4 x i8], align 4
+  %p = getelementptr inbounds [4 x i8], [4 x i8]* %a, i64 0, i64 0
+  call void @llvm.memset.p0i8.i64(i8* align 4 %p, i8 %x, i64 4, i1 false)
+  call void @h()
+  %v = load i8, i8* %p, align 1
+  ret i8 %v
+}
+
+; Inputs/cache_key_callee.ll has the same function with @h2 declared
+; readnone, so it misses the entry stored for this one, which keeps the load.
+; CHECK-LABEL: define i8 @callee_attrs(
+; CHECK:         %v = load i8, i8* %p, align 1
+; CHECK-NEXT:    ret i8 %v
+; CALLEE-LABEL: define i8 @callee_attrs(
+; CALLEE-NOT:     load
+; CALLEE:         ret i8 %x
+; CALLEE-STATS: cpass cache: 1 lookups, 0 hits (0.0%), 1 stores
+define i8 @callee_attrs(i8 %x) {
+entry:
+  %a = alloca [4 x i8], align 4
+  %p = getelementptr inbounds [4 x i8], [4 x i8]* %a, i64 0, i64 0
+  call void @llvm.memset.p0i8.i64(i8* align 4 %p, i8 %x, i64 4, i1 false)
+  call void @h2()
+  %v = load i8, i8* %p, align 1
+  ret i8 %v
+}
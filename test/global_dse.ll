@@ -0,0 +1,108 @@
+; global_dse removes stores to local variables that no path reads.
+; RUN: %global-dse -S < %s | FileCheck %s
+; RUN: %global-dse -dse-stats -disable-output < %s 2>&1 \
+; RUN:   | FileCheck --check-prefix=STATS %s
+
+; STATS: global_dse: 4 stores removed
+
+; Overwritten before it is read.
+; CHECK-LABEL: define i32 @overwritten(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    %a = alloca i32, align 4
+; CHECK-NEXT:    store i32 2, i32* %a, align 4
+; CHECK-NEXT:    %0 = load i32, i32* %a, align 4
+define i32 @overwritten() {
+entry:
+  %a = alloca i32, align 4
+  store i32 1, i32* %a, align 4
+  store i32 2, i32* %a, align 4
+  %0 = load i32, i32* %a, align 4
+  ret i32 %0
+}
+
+; Overwritten on both arms of a branch; the store after the last load is
+; dead at the return.
+; CHECK-LABEL: define i32 @both_arms(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    %a = alloca i32, align 4
+; CHECK-NEXT:    br i1 %c, label %then, label %else
+; CHECK:       join:
+; CHECK-NEXT:    %0 = load i32, i32* %a, align 4
+; CHECK-NEXT:    ret i32 %0
+define i32 @both_arms(i1 %c) {
+entry:
+  %a = alloca i32, align 4
+  store i32 1, i32* %a, align 4
+  br i1 %c, label %then, label %else
+
+then:
+  store i32 2, i32* %a, align 4
+  br label %join
+
+else:
+  store i32 3, i32* %a, align 4
+  br label %join
+
+join:
+  %0 = load i32, i32* %a, align 4
+  store i32 4, i32* %a, align 4
+  ret i32 %0
+}
+
+; Read on one path only, or around a loop: kept.
+; CHECK-LABEL: define i32 @live(
+; CHECK:         store i32 1, i32* %a, align 4
+; CHECK:       loop:
+; CHECK:         store i32 %inc, i32* %a, align 4
+define i32 @live(i1 %c, i32 %n) {
+entry:
+  %a = alloca i32, align 4
+  store i32 1, i32* %a, align 4
+  br i1 %c, label %loop, label %exit
+
+loop:
+  %0 = load i32, i32* %a, align 4
+  %inc = add i32 %0, 1
+  store i32 %inc, i32* %a, align 4
+  %cmp = icmp slt i32 %inc, %n
+  br i1 %cmp, label %loop, label %exit
+
+exit:
+  ret i32 0
+}
+
+; Never read.
+; CHECK-LABEL: define void @unread(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    %a = alloca i32, align 4
+; CHECK-NEXT:    ret void
+define void @unread(i32 %n) {
+entry:
+  %a = alloca i32, align 4
+  store i32 %n, i32* %a, align 4
+  ret void
+}
+
+; Variables whose address escapes, stores that are volatile and arguments
+; may be read elsewhere: kept.
+; CHECK-LABEL: define void @escaping(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    %a = alloca i32, align 4
+; CHECK-NEXT:    %b = alloca i32, align 4
+; CHECK-NEXT:    store i32 1, i32* %a, align 4
+; CHECK-NEXT:    call void @use(i32* %a)
+; CHECK-NEXT:    store volatile i32 2, i32* %b, align 4
+; CHECK-NEXT:    store i32 3, i32* %p, align 4
+; CHECK-NEXT:    ret void
+declare void @use(i32*)
+
+define void @escaping(i32* %p) {
+entry:
+  %a = alloca i32, align 4
+  %b = alloca i32, align 4
+  store i32 1, i32* %a, align 4
+  call void @use(i32* %a)
+  store volatile i32 2, i32* %b, align 4
+  store i32 3, i32* %p, align 4
+  ret void
+}
@@ -0,0 +1,21 @@
+; Run after copy_prop, global_dse removes the stores whose loads copy_prop
+; replaced.
+; RUN: %cpass -load %global-dse-plugin -global_dse -S < %s | FileCheck %s
+
+; CHECK-LABEL: define i32 @after_copy_prop(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    %a = alloca i32, align 4
+; CHECK-NEXT:    %b = alloca i32, align 4
+; CHECK-NEXT:    %add = add nsw i32 %n, %n
+; CHECK-NEXT:    ret i32 %add
+define i32 @after_copy_prop(i32 %n) {
+entry:
+  %a = alloca i32, align 4
+  %b = alloca i32, align 4
+  store i32 %n, i32* %a, align 4
+  %0 = load i32, i32* %a, align 4
+  store i32 %0, i32* %b, align 4
+  %1 = load i32, i32* %b, align 4
+  %add = add nsw i32 %0, %1
+  ret i32 %add
+}
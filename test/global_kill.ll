@@ -0,0 +1,78 @@
+; A store on any path into a block kills the copies of that address coming
+; from other blocks, so loads after the kill must stay.
+; RUN: %cpass -S < %s | FileCheck %s
+
+; CHECK-LABEL: define i32 @one_arm(
+; CHECK:       join:
+; CHECK-NEXT:    %0 = load i32, i32* %y, align 4
+; CHECK-NEXT:    ret i32 %0
+define i32 @one_arm(i1 %c) {
+entry:
+  %y = alloca i32, align 4
+  store i32 7, i32* %y, align 4
+  br i1 %c, label %then, label %join
+
+then:
+  store i32 9, i32* %y, align 4
+  br label %join
+
+join:
+  %0 = load i32, i32* %y, align 4
+  ret i32 %0
+}
+
+; The store in the loop body kills the initial copy of %i in the header.
+; CHECK-LABEL: define i32 @loop_carried(
+; CHECK:       cond:
+; CHECK-NEXT:    %0 = load i32, i32* %i, align 4
+; CHECK-NEXT:    %cmp = icmp slt i32 %0, %n
+; CHECK:       exit:
+; CHECK-NEXT:    %1 = load i32, i32* %i, align 4
+; CHECK-NEXT:    ret i32 %1
+define i32 @loop_carried(i32 %n) {
+entry:
+  %i = alloca i32, align 4
+  store i32 0, i32* %i, align 4
+  br label %cond
+
+cond:
+  %0 = load i32, i32* %i, align 4
+  %cmp = icmp slt i32 %0, %n
+  br i1 %cmp, label %body, label %exit
+
+body:
+  store i32 %n, i32* %i, align 4
+  br label %cond
+
+exit:
+  %1 = load i32, i32* %i, align 4
+  ret i32 %1
+}
+
+; A store that kills a copy in one block does not affect copies of other
+; addresses flowing through it.
+; CHECK-LABEL: define i32 @unrelated(
+; CHECK:       next:
+; CHECK-NEXT:    store i32 2, i32* %b, align 4
+; CHECK-NEXT:    br label %last
+; CHECK:       last:
+; CHECK-NEXT:    %add = add nsw i32 1, 2
+; CHECK-NEXT:    ret i32 %add
+define i32 @unrelated() {
+entry:
+  %a = alloca i32, align 4
+  %b = alloca i32, align 4
+  store i32 1, i32* %a, align 4
+  store i32 1, i32* %b, align 4
+  br label %next
+
+next:
+  store i32 2, i32* %b, align 4
+  br label %last
+
+last:
+  %0 = load i32, i32* %a, align 4
+  %1 = load i32, i32* %b, align 4
+  %add = add nsw i32 %0, %1
+  ret i32 %add
+}
@@ -0,0 +1,127 @@
+; Copies that reach a block along every incoming edge (CPIn) are propagated
+; into it by the global phase.
+; RUN: %cpass -S < %s | FileCheck %s
+
+; CHECK-LABEL: define i32 @straight_line(
+; CHECK:       next:
+; CHECK-NEXT:    %add = add nsw i32 5, 5
+; CHECK-NEXT:    ret i32 %add
+define i32 @straight_line() {
+entry:
+  %x = alloca i32, align 4
+  store i32 5, i32* %x, align 4
+  br label %next
+
+next:
+  %0 = load i32, i32* %x, align 4
+  %1 = load i32, i32* %x, align 4
+  %add = add nsw i32 %0, %1
+  ret i32 %add
+}
+
+; %x is stored once before the branch and never again, so it is available at
+; the join. %y is stored on both arms but by different copies, so it is not.
+; CHECK-LABEL: define i32 @diamond(
+; CHECK:       join:
+; CHECK-NEXT:    %0 = load i32, i32* %y, align 4
+; CHECK-NEXT:    %add = add nsw i32 5, %0
+; CHECK-NEXT:    ret i32 %add
+define i32 @diamond(i1 %c) {
+entry:
+  %x = alloca i32, align 4
+  %y = alloca i32, align 4
+  store i32 5, i32* %x, align 4
+  br i1 %c, label %then, label %else
+
+then:
+  store i32 7, i32* %y, align 4
+  br label %join
+
+else:
+  store i32 7, i32* %y, align 4
+  br label %join
+
+join:
+  %0 = load i32, i32* %x, align 4
+  %1 = load i32, i32* %y, align 4
+  %add = add nsw i32 %0, %1
+  ret i32 %add
+}
+
+; A copy that is not killed in a loop is available in the header, the body
+; and the exit.
+; CHECK-LABEL: define i32 @loop_invariant(
+; CHECK:       cond:
+; CHECK-NEXT:    %0 = load i32, i32* %i, align 4
+; CHECK-NEXT:    %cmp = icmp slt i32 %0, %n
+; CHECK:       body:
+; CHECK-NEXT:    %1 = load i32, i32* %i, align 4
+; CHECK-NEXT:    %inc = add nsw i32 %1, 3
+; CHECK-NEXT:    store i32 %inc, i32* %i, align 4
+; CHECK:       exit:
+; CHECK-NEXT:    ret i32 3
+define i32 @loop_invariant(i32 %n) {
+entry:
+  %i = alloca i32, align 4
+  %s = alloca i32, align 4
+  store i32 0, i32* %i, align 4
+  store i32 3, i32* %s, align 4
+  br label %cond
+
+cond:
+  %0 = load i32, i32* %i, align 4
+  %cmp = icmp slt i32 %0, %n
+  br i1 %cmp, label %body, label %exit
+
+body:
+  %1 = load i32, i32* %s, align 4
+  %2 = load i32, i32* %i, align 4
+  %inc = add nsw i32 %2, %1
+  store i32 %inc, i32* %i, align 4
+  br label %cond
+
+exit:
+  %3 = load i32, i32* %s, align 4
+  ret i32 %3
+}
+
+; The copy into %y is made from a load that the global phase removes. Its
+; source must be rewritten before the copy is propagated into %last.
+; CHECK-LABEL: define i32 @copy_of_removed_load(
+; CHECK:       next:
+; CHECK-NEXT:    store i32 5, i32* %y, align 4
+; CHECK-NEXT:    br label %last
+; CHECK:       last:
+; CHECK-NEXT:    ret i32 5
+define i32 @copy_of_removed_load() {
+entry:
+  %x = alloca i32, align 4
+  %y = alloca i32, align 4
+  store i32 5, i32* %x, align 4
+  br label %next
+
+next:
+  %0 = load i32, i32* %x, align 4
+  store i32 %0, i32* %y, align 4
+  br label %last
+
+last:
+  %1 = load i32, i32* %y, align 4
+  ret i32 %1
+}
+
+; Unreachable blocks have no data-flow information and are left alone.
+; CHECK-LABEL: define i32 @unreachable(
+; CHECK:       dead:
+; CHECK-NEXT:    %0 = load i32, i32* %x, align 4
+; CHECK-NEXT:    ret i32 %0
+define i32 @unreachable() {
+entry:
+  %x = alloca i32, align 4
+  store i32 5, i32* %x, align 4
+  ret i32 0
+
+dead:
+  %0 = load i32, i32* %x, align 4
+  ret i32 %0
+}
@@ -0,0 +1,196 @@
+/*
+ * cpass-incremental: checks DataFlowAnalysis::update against a new analysis.
+ * Each function is edited in a few random blocks at a time, by adding,
+ * removing and retargeting stores, and now and then by changing or
+ * splitting a branch; after every edit the updated analysis must give the
+ * same ACP table for every block as an analysis built from scratch. The
+ * functions are sized to use each of the analysis' bit-set types, and grow
+ * out of them as stores are added. A second analysis of each function is
+ * solved in slices on several threads, and must give the same tables.
+ *
+ * usage: cpass-incremental [-functions=N] [-edits=N]
+ */
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "data_flow.h"
+
+using namespace llvm;
+using namespace std;
+
+static cl::opt<unsigned> nr_functions("functions",
+                                      cl::desc("functions per size"),
+                                      cl::init(4));
+static cl::opt<unsigned> nr_edits("edits", cl::desc("edits per function"),
+                                  cl::init(100));
+
+/*
+ * makeFunctionSource generates a function of nr_links conditional blocks
+ * that copy between nr_vars variables, with a loop around part of the chain
+ * and a block that is never reached.
+ */
+static string makeFunctionSource(mt19937 &rng, unsigned nr_vars,
+                                 unsigned nr_links) {
+  string s;
+  raw_string_ostream os(s);
+
+  os << "define i32 @f(i32 %n) {\n"
+     << "entry:\n";
+  for (unsigned v = 0; v < nr_vars; v++) {
+    os << "  %v" << v << " = alloca i32, align 4\n";
+  }
+  for (unsigned v = 0; v < nr_vars; v++) {
+    os << "  store i32 " << v << ", i32* %v" << v << ", align 4\n";
+  }
+  os << "  br label %link0\n";
+
+  for (unsigned l = 0; l < nr_links; l++) {
+    unsigned src = rng() % nr_vars, dst = rng() % nr_vars;
+    // some side blocks branch back to an earlier link
+    unsigned next = l + 1;
+    if (l > 2 && rng() % 8 == 0) next = l - 1 - rng() % 3;
+    os << "\nlink" << l << ":\n"
+       << "  %a" << l << " = load i32, i32* %v" << src << ", align 4\n"
+       << "  %c" << l << " = icmp slt i32 %a" << l << ", %n\n"
+       << "  br i1 %c" << l << ", label %side" << l << ", label %link"
+       << l + 1 << "\n"
+       << "\nside" << l << ":\n"
+       << "  %b" << l << " = load i32, i32* %v" << src << ", align 4\n"
+       << "  store i32 %b" << l << ", i32* %v" << dst << ", align 4\n"
+       << "  br label %link" << next << "\n";
+  }
+
+  os << "\nlink" << nr_links << ":\n"
+     << "  %r = load i32, i32* %v0, align 4\n"
+     << "  ret i32 %r\n"
+     << "\ndead:\n"
+     << "  store i32 7, i32* %v0, align 4\n"
+     << "  br label %link0\n"
+     << "}\n";
+  return os.str();
+}
+
+/*
+ * edit makes a random change to a few blocks of F and adds them to modified.
+ */
+static void edit(mt19937 &rng, Function &F, vector<AllocaInst *> &vars,
+                 vector<BasicBlock *> &modified) {
+  vector<BasicBlock *> blocks;
+  for (BasicBlock &bb : F) blocks.push_back(&bb);
+  Type *i32 = Type::getInt32Ty(F.getContext());
+
+  unsigned nr_blocks = 1 + rng() % 3;
+  for (unsigned i = 0; i < nr_blocks; i++) {
+    BasicBlock *bb = blocks[rng() % blocks.size()];
+    vector<StoreInst *> stores;
+    for (Instruction &ins : *bb) {
+      if (auto *store = dyn_cast<StoreInst>(&ins)) stores.push_back(store);
+    }
+    AllocaInst *var = vars[rng() % vars.size()];
+    unsigned kind = rng() % 16;
+
+    if (kind < 6 || stores.empty()) {
+      // add stores of constants before a random store or the terminator
+      Instruction *before =
+          stores.empty() ? bb->getTerminator() : stores[rng() % stores.size()];
+      unsigned nr_stores = 1 + (rng() % 4 == 0 ? rng() % 8 : 0);
+      for (unsigned s = 0; s < nr_stores; s++) {
+        new StoreInst(ConstantInt::get(i32, rng() % 100),
+                      vars[rng() % vars.size()], before);
+      }
+    } else if (kind < 10) {
+      stores[rng() % stores.size()]->eraseFromParent();
+    } else if (kind < 14) {
+      stores[rng() % stores.size()]->setOperand(1, var);
+    } else if (kind == 14) {
+      // retarget a branch, which changes the CFG, to one of the generated
+      // blocks: the blocks split off them use values of the blocks before
+      BasicBlock *target = blocks[1 + rng() % (blocks.size() - 1)];
+      auto *br = dyn_cast<BranchInst>(bb->getTerminator());
+      if (!br || !target->hasName()) continue;
+      br->setSuccessor(rng() % br->getNumSuccessors(), target);
+    } else {
+      // split the block before one of its stores, adding a block
+      StoreInst *store = stores[rng() % stores.size()];
+      modified.push_back(bb->splitBasicBlock(store));
+    }
+    modified.push_back(bb);
+  }
+}
+
+/*
+ * check returns true if dfa gives the same ACP table as a new analysis for
+ * every block of F.
+ */
+static bool check(cpass::DataFlowAnalysis &dfa, Function &F) {
+  cpass::DataFlowAnalysis fresh(F);
+  for (BasicBlock &bb : F) {
+    if (dfa.getACP(bb) != fresh.getACP(bb)) {
+      errs() << "cpass-incremental: ACP of ";
+      bb.printAsOperand(errs(), false);
+      errs() << " differs from a new analysis\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv,
+                              "DataFlowAnalysis::update consistency test\n");
+
+  // about 40, 150 and 600 copies: one size for each bit-set type
+  const unsigned sizes[][2] = {{4, 12}, {6, 70}, {8, 300}};
+  unsigned nr_updates = 0;
+  mt19937 rng(1);
+
+  for (auto &size : sizes) {
+    for (unsigned f = 0; f < nr_functions; f++) {
+      LLVMContext ctx;
+      SMDiagnostic err;
+      std::unique_ptr<Module> m = parseAssemblyString(
+          makeFunctionSource(rng, size[0], size[1]), err, ctx);
+      if (!m) {
+        err.print("cpass-incremental", errs());
+        return 1;
+      }
+      Function &F = *m->getFunction("f");
+      vector<AllocaInst *> vars;
+      for (Instruction &ins : F.getEntryBlock()) {
+        if (auto *var = dyn_cast<AllocaInst>(&ins)) vars.push_back(var);
+      }
+
+      cpass::DataFlowAnalysis dfa(F);
+      cpass::DataFlowAnalysis sliced(F, nullptr,
+                                     cpass::DataFlowAnalysis::AUTO, 3);
+      for (unsigned e = 0; e < nr_edits; e++) {
+        vector<BasicBlock *> modified;
+        edit(rng, F, vars, modified);
+        if (verifyFunction(F, &errs())) {
+          return 1;
+        }
+        dfa.update(modified);
+        sliced.update(modified);
+        nr_updates++;
+        if (!check(dfa, F) || !check(sliced, F)) {
+          errs() << "after edit " << e << " of:\n" << F;
+          return 1;
+        }
+      }
+    }
+  }
+
+  outs() << "cpass-incremental: " << nr_updates << " updates matched\n";
+  return 0;
+}
@@ -0,0 +1,32 @@
+; cpass-jit keeps the state of global variables across a tier-up: the
+; re-optimized copy of the module uses the globals of the first, internal
+; ones included, instead of starting from their initializers.
+; RUN: %cpass-jit -runs=4 -tier-up-after=2 %s | FileCheck %s
+
+; CHECK:      run 1 101
+; CHECK-NEXT: run 2 102
+; CHECK-NEXT: run 3 103
+; CHECK-NEXT: run 4 104
+
+@.fmt = private unnamed_addr constant [11 x i8] c"run %d %d\0A\00"
+@count = dso_local global i32 0
+@hidden = internal global i32 100
+
+declare i32 @printf(i8*, ...)
+
+define internal i32 @bump(i32* %p) {
+entry:
+  %0 = load i32, i32* %p, align 4
+  %1 = add i32 %0, 1
+  store i32 %1, i32* %p, align 4
+  ret i32 %1
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %c = call i32 @bump(i32* @count)
+  %h = call i32 @bump(i32* @hidden)
+  %f = getelementptr [11 x i8], [11 x i8]* @.fmt, i32 0, i32 0
+  %0 = call i32 (i8*, ...) @printf(i8* %f, i32 %c, i32 %h)
+  ret i32 0
+}
@@ -0,0 +1,62 @@
+# lit configuration for the cpass tests.
+#
+# Substitutions:
+#   %cpass   opt with the copy_prop plugin loaded and the pass enabled
+#   %avail-cse
+#            opt with the avail_cse plugin loaded and the pass enabled
+#   %global-dse
+#            opt with the global_dse plugin loaded and the pass enabled
+#   %global-dse-plugin
+#            the global_dse plugin, to load it after copy_prop in %cpass
+#   %load-pre
+#            opt with the load_pre plugin loaded and the pass enabled
+#   %machine-cp
+#            llc with the machine_copy_prop plugin loaded, running only that
+#            pass on MIR
+#   %cpass-server, %cpass-client
+#            the compile server and its client
+#   %cpass-batch
+#            the streaming batch driver
+#   %cpass-jit
+#            the example JIT driver
+#   %python  the python interpreter found by CMake (for test generators)
+
+import os
+
+import lit.formats
+
+config.name = "cpass"
+config.test_format = lit.formats.ShTest(True)
+config.suffixes = [".ll", ".mir", ".test"]
+config.excludes = ["Inputs", "CMakeLists.txt"]
+
+config.test_source_root = os.path.dirname(__file__)
+config.test_exec_root = config.cpass_obj_root
+
+config.environment["PATH"] = os.pathsep.join(
+    [config.llvm_tools_dir, config.environment.get("PATH", "")])
+
+# before %cpass, which is a prefix of both
+config.substitutions.append(("%cpass-server", config.cpass_server))
+config.substitutions.append(("%cpass-client", config.cpass_client))
+config.substitutions.append(("%cpass-batch", config.cpass_batch))
+config.substitutions.append(("%cpass-jit", config.cpass_jit))
+config.substitutions.append(
+    ("%cpass", "opt -enable-new-pm=0 -load {} -copy_prop".format(
+        config.copy_prop_plugin)))
+config.substitutions.append(
+    ("%avail-cse", "opt -enable-new-pm=0 -load {} -avail_cse".format(
+        config.avail_cse_plugin)))
+# before %global-dse, which is a prefix of it
+config.substitutions.append(("%global-dse-plugin", config.global_dse_plugin))
+config.substitutions.append(
+    ("%global-dse", "opt -enable-new-pm=0 -load {} -global_dse".format(
+        config.global_dse_plugin)))
+config.substitutions.append(
+    ("%load-pre", "opt -enable-new-pm=0 -load {} -load_pre".format(
+        config.load_pre_plugin)))
+config.substitutions.append(
+    ("%machine-cp",
+     "llc -load {} -run-pass=machine_copy_prop -verify-machineinstrs".format(
+         config.machine_copy_prop_plugin)))
+config.substitutions.append(("%python", config.python))
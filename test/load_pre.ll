@@ -0,0 +1,163 @@
+; load_pre turns loads whose value some paths already know into phis,
+; loading on the other paths, without adding a load to any path.
+; RUN: %load-pre -S < %s | FileCheck %s
+; RUN: %load-pre -pre-stats -disable-output < %s 2>&1 \
+; RUN:   | FileCheck --check-prefix=STATS %s
+
+; STATS: load_pre: 4 loads inserted, 5 loads removed
+
+declare void @init(i32*)
+declare void @f()
+
+; Stored on both arms of an if/else, so the load at the join is fully
+; redundant.
+; CHECK-LABEL: define i32 @join(
+; CHECK:       join:
+; CHECK-NEXT:    [[A:%.*]] = phi i32 [ %n, %else ], [ 5, %then ]
+; CHECK-NEXT:    ret i32 [[A]]
+define i32 @join(i1 %c, i32 %n) {
+entry:
+  %a = alloca i32, align 4
+  store i32 %n, i32* %a, align 4
+  br i1 %c, label %then, label %else
+
+then:
+  store i32 5, i32* %a, align 4
+  br label %join
+
+else:
+  call void @f()
+  br label %join
+
+join:
+  %0 = load i32, i32* %a, align 4
+  ret i32 %0
+}
+
+; A call may write a variable whose address escapes: the load at the join
+; is redundant on the other path only, so it is reloaded after the call.
+; CHECK-LABEL: define i32 @clobbered(
+; CHECK:       then:
+; CHECK-NEXT:    call void @f()
+; CHECK-NEXT:    [[PRE:%.*]] = load i32, i32* %n, align 4
+; CHECK-NEXT:    br label %join
+; CHECK:       join:
+; CHECK-NEXT:    [[N:%.*]] = phi i32 [ [[PRE]], %then ], [ %0, %entry ]
+; CHECK-NEXT:    %r = add i32 %0, [[N]]
+define i32 @clobbered(i1 %c) {
+entry:
+  %n = alloca i32, align 4
+  call void @init(i32* %n)
+  %0 = load i32, i32* %n, align 4
+  br i1 %c, label %then, label %join
+
+then:
+  call void @f()
+  br label %join
+
+join:
+  %1 = load i32, i32* %n, align 4
+  %r = add i32 %0, %1
+  ret i32 %r
+}
+
+; The loop header reloads the bound on every iteration, though only some
+; iterations call a function that may change it: it is loaded before the
+; loop and after the call instead, and the counter stored at the end of the
+; body becomes a phi.
+; CHECK-LABEL: define i32 @loop(
+; CHECK:         call void @init(i32* %n)
+; CHECK-NEXT:    store i32 0, i32* %i, align 4
+; CHECK-NEXT:    [[PRE:%.*]] = load i32, i32* %n, align 4
+; CHECK-NEXT:    br label %header
+; CHECK:       header:
+; CHECK-NEXT:    [[N:%.*]] = phi i32 [ [[LATCH:%.*]], %latch ], [ [[PRE]], %entry ]
+; CHECK-NEXT:    [[I:%.*]] = phi i32 [ %iv1, %latch ], [ 0, %entry ]
+; CHECK-NEXT:    %cmp = icmp slt i32 [[I]], [[N]]
+; CHECK:       call:
+; CHECK-NEXT:    call void @f()
+; CHECK-NEXT:    [[RELOAD:%.*]] = load i32, i32* %n, align 4
+; CHECK-NEXT:    br label %latch
+; CHECK:       latch:
+; CHECK-NEXT:    [[LATCH]] = phi i32 [ [[RELOAD]], %call ], [ [[N]], %body ]
+define i32 @loop(i32 %k) {
+entry:
+  %n = alloca i32, align 4
+  %i = alloca i32, align 4
+  call void @init(i32* %n)
+  store i32 0, i32* %i, align 4
+  br label %header
+
+header:
+  %iv = load i32, i32* %i, align 4
+  %lim = load i32, i32* %n, align 4
+  %cmp = icmp slt i32 %iv, %lim
+  br i1 %cmp, label %body, label %exit
+
+body:
+  %hit = icmp eq i32 %iv, %k
+  br i1 %hit, label %call, label %latch
+
+call:
+  call void @f()
+  br label %latch
+
+latch:
+  %iv1 = add i32 %iv, 1
+  store i32 %iv1, i32* %i, align 4
+  br label %header
+
+exit:
+  ret i32 %iv
+}
+
+; Stored on one path only and never before: the load goes on the edge that
+; lacks the value, a critical edge, which keeps the block made for it.
+; CHECK-LABEL: define i32 @critical(
+; CHECK:         br i1 %c, label %then, label %[[EDGE:.*]]
+; CHECK:       [[EDGE]]:
+; CHECK-NEXT:    [[PRE:%.*]] = load i32, i32* %a, align 4
+; CHECK-NEXT:    br label %join
+; CHECK:       join:
+; CHECK-NEXT:    [[A:%.*]] = phi i32 [ [[PRE]], %[[EDGE]] ], [ 5, %then ]
+; CHECK-NEXT:    ret i32 [[A]]
+define i32 @critical(i1 %c) {
+entry:
+  %a = alloca i32, align 4
+  br i1 %c, label %then, label %join
+
+then:
+  store i32 5, i32* %a, align 4
+  br label %join
+
+join:
+  %0 = load i32, i32* %a, align 4
+  ret i32 %0
+}
+
+; Loaded on one arm only: moving the load before the branch would lengthen
+; the other path, so it stays, and no edge block is left behind.
+; CHECK-LABEL: define i32 @one_arm(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    %n = alloca i32, align 4
+; CHECK-NEXT:    call void @init(i32* %n)
+; CHECK-NEXT:    br i1 %c, label %then, label %join
+; CHECK:       then:
+; CHECK-NEXT:    %0 = load i32, i32* %n, align 4
+; CHECK-NEXT:    br label %join
+; CHECK:       join:
+; CHECK-NEXT:    %r = phi i32 [ %0, %then ], [ 0, %entry ]
+define i32 @one_arm(i1 %c) {
+entry:
+  %n = alloca i32, align 4
+  call void @init(i32* %n)
+  br i1 %c, label %then, label %join
+
+then:
+  %0 = load i32, i32* %n, align 4
+  br label %join
+
+join:
+  %r = phi i32 [ %0, %then ], [ 0, %entry ]
+  ret i32 %r
+}
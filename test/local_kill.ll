@@ -0,0 +1,61 @@
+; A store to an address kills the copy previously recorded for it, so later
+; loads see the new value.
+; RUN: %cpass -S < %s | FileCheck %s
+
+; CHECK-LABEL: define i32 @redefine(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    %a = alloca i32, align 4
+; CHECK-NEXT:    store i32 1, i32* %a, align 4
+; CHECK-NEXT:    store i32 2, i32* %a, align 4
+; CHECK-NEXT:    %add = add nsw i32 1, 2
+; CHECK-NEXT:    ret i32 %add
+; CHECK-NEXT:  }
+define i32 @redefine() {
+entry:
+  %a = alloca i32, align 4
+  store i32 1, i32* %a, align 4
+  %0 = load i32, i32* %a, align 4
+  store i32 2, i32* %a, align 4
+  %1 = load i32, i32* %a, align 4
+  %add = add nsw i32 %0, %1
+  ret i32 %add
+}
+
+; Storing a computed value replaces the constant recorded for %a.
+; CHECK-LABEL: define i32 @increment(
+; CHECK:         store i32 %n, i32* %a, align 4
+; CHECK-NEXT:    %inc = add nsw i32 %n, 1
+; CHECK-NEXT:    store i32 %inc, i32* %a, align 4
+; CHECK-NEXT:    ret i32 %inc
+define i32 @increment(i32 %n) {
+entry:
+  %a = alloca i32, align 4
+  store i32 %n, i32* %a, align 4
+  %0 = load i32, i32* %a, align 4
+  %inc = add nsw i32 %0, 1
+  store i32 %inc, i32* %a, align 4
+  %1 = load i32, i32* %a, align 4
+  ret i32 %1
+}
+
+; A copy made in one arm of a branch is not available in the other arm.
+; CHECK-LABEL: define i32 @sibling(
+; CHECK:       then:
+; CHECK-NEXT:    store i32 3, i32* %a, align 4
+; CHECK-NEXT:    ret i32 3
+; CHECK:       else:
+; CHECK-NEXT:    %0 = load i32, i32* %a, align 4
+; CHECK-NEXT:    ret i32 %0
+define i32 @sibling(i32* %a, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  store i32 3, i32* %a, align 4
+  %t = load i32, i32* %a, align 4
+  ret i32 %t
+
+else:
+  %0 = load i32, i32* %a, align 4
+  ret i32 %0
+}
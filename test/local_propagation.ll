@@ -0,0 +1,78 @@
+; Copies made within a block are propagated into later uses in the same block
+; and the loads they make redundant are removed.
+; RUN: %cpass -S < %s | FileCheck %s
+
+; CHECK-LABEL: define i32 @constant(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    %a = alloca i32, align 4
+; CHECK-NEXT:    store i32 1, i32* %a, align 4
+; CHECK-NEXT:    ret i32 1
+; CHECK-NEXT:  }
+define i32 @constant() {
+entry:
+  %a = alloca i32, align 4
+  store i32 1, i32* %a, align 4
+  %0 = load i32, i32* %a, align 4
+  ret i32 %0
+}
+
+; A loaded value stored elsewhere is itself a copy of the original source, so
+; both loads go away and the second store is rewritten.
+; CHECK-LABEL: define i32 @chain(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    %a = alloca i32, align 4
+; CHECK-NEXT:    %b = alloca i32, align 4
+; CHECK-NEXT:    %c = alloca i32, align 4
+; CHECK-NEXT:    store i32 1, i32* %a, align 4
+; CHECK-NEXT:    store i32 1, i32* %b, align 4
+; CHECK-NEXT:    %add = add nsw i32 1, 1
+; CHECK-NEXT:    store i32 %add, i32* %c, align 4
+; CHECK-NEXT:    ret i32 %add
+; CHECK-NEXT:  }
+define i32 @chain() {
+entry:
+  %a = alloca i32, align 4
+  %b = alloca i32, align 4
+  %c = alloca i32, align 4
+  store i32 1, i32* %a, align 4
+  %0 = load i32, i32* %a, align 4
+  store i32 %0, i32* %b, align 4
+  %1 = load i32, i32* %a, align 4
+  %2 = load i32, i32* %b, align 4
+  %add = add nsw i32 %1, %2
+  store i32 %add, i32* %c, align 4
+  %3 = load i32, i32* %c, align 4
+  ret i32 %3
+}
+
+; Arguments spilled to their .addr slot (the clang -O0 prologue) are
+; propagated into their uses.
+; CHECK-LABEL: define i32 @argument(
+; CHECK:         store i32 %n, i32* %n.addr, align 4
+; CHECK-NEXT:    %mul = mul nsw i32 %n, %n
+; CHECK-NEXT:    ret i32 %mul
+define i32 @argument(i32 %n) {
+entry:
+  %n.addr = alloca i32, align 4
+  store i32 %n, i32* %n.addr, align 4
+  %0 = load i32, i32* %n.addr, align 4
+  %1 = load i32, i32* %n.addr, align 4
+  %mul = mul nsw i32 %0, %1
+  ret i32 %mul
+}
+
+; Calls take the propagated values as arguments.
+; CHECK-LABEL: define void @call(
+; CHECK:         store i32 %x, i32* %x.addr, align 4
+; CHECK-NEXT:    call void @use(i32 %x)
+; CHECK-NEXT:    ret void
+define void @call(i32 %x) {
+entry:
+  %x.addr = alloca i32, align 4
+  store i32 %x, i32* %x.addr, align 4
+  %0 = load i32, i32* %x.addr, align 4
+  call void @use(i32 %0)
+  ret void
+}
+
+declare void @use(i32)
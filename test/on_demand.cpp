@@ -0,0 +1,218 @@
+/*
+ * cpass-on-demand: checks the ACP tables DataFlowAnalysis finds on demand
+ * against those from the solved sets. An analysis on demand only builds the
+ * entries of a block's table that propagateBlock can observe, so global
+ * propagation with either must give the same function. Functions are random
+ * chains of conditional blocks with loops, some of which load, and are
+ * checked again after each of a series of random edits; after an edit, the
+ * tables of the analysis brought up to date with update must also be those
+ * of a new analysis.
+ *
+ * usage: cpass-on-demand [-functions=N] [-edits=N]
+ */
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "data_flow.h"
+
+using namespace llvm;
+using namespace std;
+
+static cl::opt<unsigned> nr_functions("functions", cl::desc("functions"),
+                                      cl::init(8));
+static cl::opt<unsigned> nr_edits("edits", cl::desc("edits per function"),
+                                  cl::init(8));
+
+/*
+ * makeFunctionSource generates a function of nr_links conditional blocks
+ * that store to nr_vars variables; one in every load_every side blocks loads
+ * one of them, and some branch back to an earlier link. One variable holds
+ * the address of another.
+ */
+static string makeFunctionSource(mt19937 &rng, unsigned nr_vars,
+                                 unsigned nr_links, unsigned load_every) {
+  string s;
+  raw_string_ostream os(s);
+
+  os << "define i32 @f(i32 %n) {\n"
+     << "entry:\n"
+     << "  %p = alloca i32*, align 8\n";
+  for (unsigned v = 0; v < nr_vars; v++) {
+    os << "  %v" << v << " = alloca i32, align 4\n";
+  }
+  os << "  store i32 %n, i32* %v0, align 4\n"
+     << "  br label %link0\n";
+
+  for (unsigned l = 0; l < nr_links; l++) {
+    unsigned var = rng() % nr_vars;
+    unsigned next = l + 1;
+    if (l > 4 && rng() % 6 == 0) next = l - 1 - rng() % 4;
+    os << "\nlink" << l << ":\n"
+       << "  %c" << l << " = icmp slt i32 " << l << ", %n\n"
+       << "  br i1 %c" << l << ", label %side" << l << ", label %link"
+       << l + 1 << "\n"
+       << "\nside" << l << ":\n";
+    if (rng() % load_every == 0) {
+      os << "  %a" << l << " = load i32, i32* %v" << var << ", align 4\n"
+         << "  store i32 %a" << l << ", i32* %v" << rng() % nr_vars
+         << ", align 4\n";
+    } else if (rng() % 8 == 0) {
+      os << "  store i32* %v" << var << ", i32** %p, align 8\n";
+    } else {
+      os << "  store i32 " << l << ", i32* %v" << var << ", align 4\n";
+    }
+    os << "  br label %link" << next << "\n";
+  }
+
+  os << "\nlink" << nr_links << ":\n"
+     << "  %r = load i32, i32* %v0, align 4\n"
+     << "  ret i32 %r\n"
+     << "}\n";
+  return os.str();
+}
+
+/*
+ * edit adds, removes or retargets a store in a few random blocks of F and
+ * adds them to modified.
+ */
+static void edit(mt19937 &rng, Function &F, vector<AllocaInst *> &vars,
+                 vector<BasicBlock *> &modified) {
+  vector<BasicBlock *> blocks;
+  for (BasicBlock &bb : F) blocks.push_back(&bb);
+  Type *i32 = Type::getInt32Ty(F.getContext());
+
+  unsigned nr_blocks = 1 + rng() % 3;
+  for (unsigned i = 0; i < nr_blocks; i++) {
+    BasicBlock *bb = blocks[rng() % blocks.size()];
+    StoreInst *store = nullptr;
+    for (Instruction &ins : *bb) {
+      if (auto *s = dyn_cast<StoreInst>(&ins)) store = s;
+    }
+    AllocaInst *var = vars[rng() % vars.size()];
+    unsigned kind = rng() % 3;
+    if (kind == 0 || !store) {
+      new StoreInst(ConstantInt::get(i32, rng() % 100), var,
+                    bb->getTerminator());
+    } else if (kind == 1 && store->getValueOperand()->getType() == i32) {
+      store->setOperand(1, var);
+    } else {
+      store->eraseFromParent();
+    }
+    modified.push_back(bb);
+  }
+}
+
+/*
+ * propagateSource returns the function in source after global propagation
+ * with the ACP tables of an analysis in mode.
+ */
+static string propagateSource(const string &source,
+                              cpass::DataFlowAnalysis::Mode mode) {
+  LLVMContext ctx;
+  SMDiagnostic err;
+  std::unique_ptr<Module> m = parseAssemblyString(source, err, ctx);
+  Function &F = *m->getFunction("f");
+  cpass::DataFlowAnalysis dfa(F, nullptr, mode);
+  for (BasicBlock *bb : dfa.getRPO()) {
+    cpass::ACPTable acp = dfa.getACP(*bb);
+    cpass::propagateBlock(*bb, acp);
+  }
+  string s;
+  raw_string_ostream os(s);
+  os << F;
+  return os.str();
+}
+
+/*
+ * contains returns true if every entry of part is in acp.
+ */
+static bool contains(const cpass::ACPTable &acp, const cpass::ACPTable &part) {
+  for (auto &entry : part) {
+    auto it = acp.find(entry.first);
+    if (it == acp.end() || it->second != entry.second) return false;
+  }
+  return true;
+}
+
+/*
+ * check returns true if the tables of dfa, an analysis on demand of F, hold
+ * those of a new one, and are part of those of the solved sets (after update
+ * they may hold more entries than needed), and if F propagates the same with
+ * tables on demand as with the solved sets.
+ */
+static bool check(cpass::DataFlowAnalysis &dfa, Function &F) {
+  cpass::DataFlowAnalysis fresh(F, nullptr,
+                                cpass::DataFlowAnalysis::ON_DEMAND);
+  cpass::DataFlowAnalysis sets(F, nullptr, cpass::DataFlowAnalysis::SETS);
+  for (BasicBlock &bb : F) {
+    cpass::ACPTable acp = dfa.getACP(bb);
+    if (!contains(acp, fresh.getACP(bb)) || !contains(sets.getACP(bb), acp)) {
+      errs() << "cpass-on-demand: ACP of ";
+      bb.printAsOperand(errs(), false);
+      errs() << " differs from a new analysis\n";
+      return false;
+    }
+  }
+
+  string source;
+  raw_string_ostream os(source);
+  os << F;
+  if (propagateSource(os.str(), cpass::DataFlowAnalysis::ON_DEMAND) !=
+      propagateSource(os.str(), cpass::DataFlowAnalysis::SETS)) {
+    errs() << "cpass-on-demand: propagation differs from the solved sets\n";
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "on demand ACP consistency test\n");
+  mt19937 rng(1);
+  unsigned nr_checks = 0;
+
+  for (unsigned f = 0; f < nr_functions; f++) {
+    LLVMContext ctx;
+    SMDiagnostic err;
+    std::unique_ptr<Module> m = parseAssemblyString(
+        makeFunctionSource(rng, 2 + f % 12, 20 + rng() % 300, 1 + f % 16),
+        err, ctx);
+    if (!m) {
+      err.print("cpass-on-demand", errs());
+      return 1;
+    }
+    Function &F = *m->getFunction("f");
+    vector<AllocaInst *> vars;
+    for (Instruction &ins : F.getEntryBlock()) {
+      auto *var = dyn_cast<AllocaInst>(&ins);
+      if (var && var->getAllocatedType()->isIntegerTy()) vars.push_back(var);
+    }
+
+    cpass::DataFlowAnalysis dfa(F, nullptr,
+                                cpass::DataFlowAnalysis::ON_DEMAND);
+    for (unsigned e = 0; e <= nr_edits; e++) {
+      if (e > 0) {
+        vector<BasicBlock *> modified;
+        edit(rng, F, vars, modified);
+        dfa.update(modified);
+      }
+      nr_checks++;
+      if (!check(dfa, F)) {
+        errs() << "after edit " << e << " of:\n" << F;
+        return 1;
+      }
+    }
+  }
+
+  outs() << "cpass-on-demand: " << nr_checks << " analyses matched\n";
+  return 0;
+}
@@ -0,0 +1,205 @@
+; Loads of bytes a memset or memcpy wrote are replaced by the value they
+; hold: a constant for a memset, or a load of the memcpy source.
+; RUN: %cpass -S < %s | FileCheck %s
+; RUN: rm -rf %t.cache
+; RUN: %cpass -cache-dir=%t.cache -S < %s > /dev/null
+; RUN: %cpass -cache-dir=%t.cache -S < %s | FileCheck %s
+
+%struct.S = type { i32, i32, i64 }
+
+declare void @llvm.memset.p0i8.i64(i8* nocapture writeonly, i8, i64, i1 immarg)
+declare void @llvm.memcpy.p0i8.p0i8.i64(i8* noalias nocapture writeonly, i8* noalias nocapture readonly, i64, i1 immarg)
+declare void @use(%struct.S*)
+
+; A memset gives the bytes it sets to loads of them. The store to %a
+; replaces them for field a only.
+; CHECK-LABEL: define i32 @memset_zero(
+; CHECK:         %1 = load i32, i32* %a2, align 8
+; CHECK-NOT:     load
+; CHECK:         %t = trunc i64 0 to i32
+; CHECK-NEXT:    %add = add i32 %1, 0
+define i32 @memset_zero() {
+entry:
+  %s = alloca %struct.S, align 8
+  %0 = bitcast %struct.S* %s to i8*
+  call void @llvm.memset.p0i8.i64(i8* align 8 %0, i8 0, i64 16, i1 false)
+  %a = getelementptr inbounds %struct.S, %struct.S* %s, i32 0, i32 0
+  store i32 5, i32* %a, align 8
+  %a2 = getelementptr inbounds %struct.S, %struct.S* %s, i32 0, i32 0
+  %1 = load i32, i32* %a2, align 8
+  %b = getelementptr inbounds %struct.S, %struct.S* %s, i32 0, i32 1
+  %2 = load i32, i32* %b, align 4
+  %c = getelementptr inbounds %struct.S, %struct.S* %s, i32 0, i32 2
+  %3 = load i64, i64* %c, align 8
+  %t = trunc i64 %3 to i32
+  %add = add i32 %1, %2
+  %add2 = add i32 %add, %t
+  ret i32 %add2
+}
+
+; A byte other than zero is repeated across the type loaded.
+; CHECK-LABEL: define float @memset_splat(
+; CHECK-NOT:     load
+; CHECK:         %1 = sitofp i32 16843009 to float
+; CHECK-NEXT:    %r = fadd float 0x3820202020000000, %1
+define float @memset_splat() {
+entry:
+  %v = alloca [4 x i32], align 16
+  %0 = bitcast [4 x i32]* %v to i8*
+  call void @llvm.memset.p0i8.i64(i8* align 16 %0, i8 1, i64 16, i1 false)
+  %e = getelementptr inbounds [4 x i32], [4 x i32]* %v, i64 0, i64 2
+  %1 = load i32, i32* %e, align 8
+  %f = bitcast i32* %e to float*
+  %2 = load float, float* %f, align 8
+  %3 = sitofp i32 %1 to float
+  %r = fadd float %2, %3
+  ret float %r
+}
+
+; A load from the destination of a memcpy reads its source instead.
+; CHECK-LABEL: define i32 @memcpy_forward(
+; CHECK:         %2 = getelementptr inbounds i8, i8* %1, i64 4
+; CHECK-NEXT:    %3 = bitcast i8* %2 to i32*
+; CHECK-NEXT:    %4 = load i32, i32* %3, align 4
+; CHECK:         %5 = bitcast i8* %1 to i32*
+; CHECK-NEXT:    %6 = load i32, i32* %5, align 8
+; CHECK-NEXT:    %add = add i32 %4, %6
+define i32 @memcpy_forward(i32 %x) {
+entry:
+  %s = alloca %struct.S, align 8
+  %t = alloca %struct.S, align 8
+  %a = getelementptr inbounds %struct.S, %struct.S* %s, i32 0, i32 0
+  store i32 %x, i32* %a, align 8
+  %0 = bitcast %struct.S* %t to i8*
+  %1 = bitcast %struct.S* %s to i8*
+  call void @llvm.memcpy.p0i8.p0i8.i64(i8* align 8 %0, i8* align 8 %1, i64 16, i1 false)
+  %tb = getelementptr inbounds %struct.S, %struct.S* %t, i32 0, i32 1
+  %2 = load i32, i32* %tb, align 4
+  %ta = getelementptr inbounds %struct.S, %struct.S* %t, i32 0, i32 0
+  %3 = load i32, i32* %ta, align 8
+  %add = add i32 %2, %3
+  ret i32 %add
+}
+
+; A memcpy of memset bytes copies the constant.
+; CHECK-LABEL: define i64 @memcpy_of_memset(
+; CHECK-NOT:     load
+; CHECK:         ret i64 0
+define i64 @memcpy_of_memset() {
+entry:
+  %s = alloca %struct.S, align 8
+  %t = alloca %struct.S, align 8
+  %0 = bitcast %struct.S* %s to i8*
+  call void @llvm.memset.p0i8.i64(i8* align 8 %0, i8 0, i64 16, i1 false)
+  %1 = bitcast %struct.S* %t to i8*
+  call void @llvm.memcpy.p0i8.p0i8.i64(i8* align 8 %1, i8* align 8 %0, i64 16, i1 false)
+  %c = getelementptr inbounds %struct.S, %struct.S* %t, i32 0, i32 2
+  %2 = load i64, i64* %c, align 8
+  ret i64 %2
+}
+
+; A store to the source after a memcpy keeps the bytes it wrote from being
+; forwarded, and only those.
+; CHECK-LABEL: define i32 @source_written(
+; CHECK:         %2 = load i32, i32* %tb, align 4
+; CHECK:         %3 = bitcast i8* %1 to i32*
+; CHECK-NEXT:    %4 = load i32, i32* %3, align 8
+; CHECK-NEXT:    %add = add i32 %2, %4
+define i32 @source_written() {
+entry:
+  %s = alloca %struct.S, align 8
+  %t = alloca %struct.S, align 8
+  %0 = bitcast %struct.S* %t to i8*
+  %1 = bitcast %struct.S* %s to i8*
+  call void @llvm.memcpy.p0i8.p0i8.i64(i8* align 8 %0, i8* align 8 %1, i64 16, i1 false)
+  %sb = getelementptr inbounds %struct.S, %struct.S* %s, i32 0, i32 1
+  store i32 1, i32* %sb, align 4
+  %tb = getelementptr inbounds %struct.S, %struct.S* %t, i32 0, i32 1
+  %2 = load i32, i32* %tb, align 4
+  %ta = getelementptr inbounds %struct.S, %struct.S* %t, i32 0, i32 0
+  %3 = load i32, i32* %ta, align 8
+  %add = add i32 %2, %3
+  ret i32 %add
+}
+
+; A memset kills the stores it overwrites.
+; CHECK-LABEL: define i64 @kills_store(
+; CHECK:         call void @llvm.memset
+; CHECK-NEXT:    ret i64 0
+define i64 @kills_store() {
+entry:
+  %s = alloca %struct.S, align 8
+  %c = getelementptr inbounds %struct.S, %struct.S* %s, i32 0, i32 2
+  store i64 7, i64* %c, align 8
+  %0 = bitcast %struct.S* %s to i8*
+  call void @llvm.memset.p0i8.i64(i8* align 8 %0, i8 0, i64 16, i1 false)
+  %1 = load i64, i64* %c, align 8
+  ret i64 %1
+}
+
+; A call may write the memory, so the memset is no longer available.
+; CHECK-LABEL: define i32 @call_kills(
+; CHECK:         %1 = load i32, i32* %b, align 4
+; CHECK-NEXT:    ret i32 %1
+define i32 @call_kills() {
+entry:
+  %s = alloca %struct.S, align 8
+  %0 = bitcast %struct.S* %s to i8*
+  call void @llvm.memset.p0i8.i64(i8* align 8 %0, i8 0, i64 16, i1 false)
+  call void @use(%struct.S* %s)
+  %b = getelementptr inbounds %struct.S, %struct.S* %s, i32 0, i32 1
+  %1 = load i32, i32* %b, align 4
+  ret i32 %1
+}
+
+; Range copies reach other blocks. A store to part of one on some path
+; kills all of it there.
+; CHECK-LABEL: define i32 @global(
+; CHECK:       join:
+; CHECK:         %2 = load i32, i32* %tb, align 4
+; CHECK-NEXT:    %add = add i32 0, %2
+define i32 @global(i1 %cond) {
+entry:
+  %s = alloca %struct.S, align 8
+  %t = alloca %struct.S, align 8
+  %0 = bitcast %struct.S* %s to i8*
+  call void @llvm.memset.p0i8.i64(i8* align 8 %0, i8 0, i64 16, i1 false)
+  %1 = bitcast %struct.S* %t to i8*
+  call void @llvm.memcpy.p0i8.p0i8.i64(i8* align 8 %1, i8* align 8 %0, i64 16, i1 false)
+  br i1 %cond, label %then, label %join
+
+then:
+  %ta = getelementptr inbounds %struct.S, %struct.S* %t, i32 0, i32 0
+  store i32 3, i32* %ta, align 8
+  br label %join
+
+join:
+  %sb = getelementptr inbounds %struct.S, %struct.S* %s, i32 0, i32 1
+  %2 = load i32, i32* %sb, align 4
+  %tb = getelementptr inbounds %struct.S, %struct.S* %t, i32 0, i32 1
+  %3 = load i32, i32* %tb, align 4
+  %add = add i32 %2, %3
+  ret i32 %add
+}
+
+; A memset on some path kills the store it overwrites.
+; CHECK-LABEL: define i64 @global_kills_store(
+; CHECK:       join:
+; CHECK-NEXT:    %1 = load i64, i64* %c, align 8
+; CHECK-NEXT:    ret i64 %1
+define i64 @global_kills_store(i1 %cond) {
+entry:
+  %s = alloca %struct.S, align 8
+  %c = getelementptr inbounds %struct.S, %struct.S* %s, i32 0, i32 2
+  store i64 7, i64* %c, align 8
+  br i1 %cond, label %then, label %join
+
+then:
+  %0 = bitcast %struct.S* %s to i8*
+  call void @llvm.memset.p0i8.i64(i8* align 8 %0, i8 0, i64 16, i1 false)
+  br label %join
+
+join:
+  %1 = load i64, i64* %c, align 8
+  ret i64 %1
+}
@@ -0,0 +1,146 @@
+; A store of the value its address already holds is removed, in the local
+; and the global phase, and counted. Only local variables that do not
+; escape are known to still hold the value: a store through a pointer
+; argument, or to a variable a call may write, is kept.
+; RUN: %cpass -S < %s | FileCheck %s
+; RUN: %cpass -prop-stats -disable-output < %s 2>&1 \
+; RUN:   | FileCheck --check-prefix=STATS %s
+
+; STATS: cpass: 4 redundant stores removed
+
+; Storing back a value just loaded from the same address.
+; CHECK-LABEL: define i32 @store_back(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    %a = alloca i32, align 4
+; CHECK-NEXT:    store i32 %n, i32* %a, align 4
+; CHECK-NEXT:    ret i32 %n
+; CHECK-NEXT:  }
+define i32 @store_back(i32 %n) {
+entry:
+  %a = alloca i32, align 4
+  store i32 %n, i32* %a, align 4
+  %0 = load i32, i32* %a, align 4
+  store i32 %0, i32* %a, align 4
+  %1 = load i32, i32* %a, align 4
+  ret i32 %1
+}
+
+; The same store twice.
+; CHECK-LABEL: define i32 @twice(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    %a = alloca i32, align 4
+; CHECK-NEXT:    store i32 %n, i32* %a, align 4
+; CHECK-NEXT:    ret i32 %n
+define i32 @twice(i32 %n) {
+entry:
+  %a = alloca i32, align 4
+  store i32 %n, i32* %a, align 4
+  store i32 %n, i32* %a, align 4
+  %0 = load i32, i32* %a, align 4
+  ret i32 %0
+}
+
+; The value a store writes is only known in another block.
+; CHECK-LABEL: define i32 @global(
+; CHECK:       then:
+; CHECK-NEXT:    br label %join
+define i32 @global(i1 %c) {
+entry:
+  %a = alloca i32, align 4
+  store i32 3, i32* %a, align 4
+  br i1 %c, label %then, label %join
+
+then:
+  %0 = load i32, i32* %a, align 4
+  store i32 %0, i32* %a, align 4
+  br label %join
+
+join:
+  %1 = load i32, i32* %a, align 4
+  ret i32 %1
+}
+
+; A copy between two addresses holding the same value.
+; CHECK-LABEL: define i32 @copy_back(
+; CHECK:         store i32 %n, i32* %b, align 4
+; CHECK-NEXT:    ret i32 %n
+define i32 @copy_back(i32 %n) {
+entry:
+  %a = alloca i32, align 4
+  %b = alloca i32, align 4
+  store i32 %n, i32* %a, align 4
+  %0 = load i32, i32* %a, align 4
+  store i32 %0, i32* %b, align 4
+  %1 = load i32, i32* %b, align 4
+  store i32 %1, i32* %a, align 4
+  ret i32 %1
+}
+
+; A store after the address is written again must stay.
+; CHECK-LABEL: define void @kept(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    %a = alloca i32, align 4
+; CHECK-NEXT:    store i32 %n, i32* %a, align 4
+; CHECK-NEXT:    store i32 0, i32* %a, align 4
+; CHECK-NEXT:    store i32 %n, i32* %a, align 4
+; CHECK-NEXT:    ret void
+define void @kept(i32 %n) {
+entry:
+  %a = alloca i32, align 4
+  store i32 %n, i32* %a, align 4
+  store i32 0, i32* %a, align 4
+  store i32 %n, i32* %a, align 4
+  ret void
+}
+
+; A volatile store must stay.
+; CHECK-LABEL: define void @kept_volatile(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    %a = alloca i32, align 4
+; CHECK-NEXT:    store i32 %n, i32* %a, align 4
+; CHECK-NEXT:    store volatile i32 %n, i32* %a, align 4
+; CHECK-NEXT:    ret void
+define void @kept_volatile(i32 %n) {
+entry:
+  %a = alloca i32, align 4
+  store i32 %n, i32* %a, align 4
+  store volatile i32 %n, i32* %a, align 4
+  ret void
+}
+
+; %a and %b may be the same address, so the store through %b may have
+; changed what %a holds.
+; CHECK-LABEL: define void @aliasing(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    store i32 1, i32* %a, align 4
+; CHECK-NEXT:    store i32 7, i32* %b, align 4
+; CHECK-NEXT:    store i32 1, i32* %a, align 4
+; CHECK-NEXT:    ret void
+define void @aliasing(i32* %a, i32* %b) {
+entry:
+  store i32 1, i32* %a, align 4
+  store i32 7, i32* %b, align 4
+  store i32 1, i32* %a, align 4
+  ret void
+}
+
+declare void @clobber(i32*)
+
+; %a escapes to the first call, so the second may write it.
+; CHECK-LABEL: define void @escaping(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:    %a = alloca i32, align 4
+; CHECK-NEXT:    call void @clobber(i32* %a)
+; CHECK-NEXT:    store i32 1, i32* %a, align 4
+; CHECK-NEXT:    call void @clobber(i32* null)
+; CHECK-NEXT:    store i32 1, i32* %a, align 4
+; CHECK-NEXT:    ret void
+define void @escaping() {
+entry:
+  %a = alloca i32, align 4
+  call void @clobber(i32* %a)
+  store i32 1, i32* %a, align 4
+  call void @clobber(i32* null)
+  store i32 1, i32* %a, align 4
+  ret void
+}
@@ -0,0 +1,40 @@
+; cpass-server gives the same result as the plugin, keeps serving across
+; connections, and reports parse errors and oversized requests to the client.
+; RUN: rm -f %t.sock
+; RUN: %python %S/Inputs/with_server.py %cpass-server %t.sock \
+; RUN:   "%cpass-client -socket=%t.sock %s -o %t.global.bc && \
+; RUN:    %cpass-client -socket=%t.sock -local < %s > %t.local.bc && \
+; RUN:    ! %cpass-client -socket=%t.sock %S/Inputs/with_server.py 2> %t.err && \
+; RUN:    %python %S/Inputs/oversized_request.py %t.sock > %t.oversized && \
+; RUN:    %cpass-client -socket=%t.sock -shutdown" 2> %t.server
+; RUN: llvm-dis < %t.global.bc | FileCheck %s --check-prefix=GLOBAL
+; RUN: llvm-dis < %t.local.bc | FileCheck %s --check-prefix=LOCAL
+; RUN: FileCheck %s --check-prefix=ERROR < %t.err
+; RUN: FileCheck %s --check-prefix=OVERSIZED < %t.oversized
+; RUN: FileCheck %s --check-prefix=SERVER < %t.server
+
+; GLOBAL-LABEL: define i32 @diamond(
+; GLOBAL:       join:
+; GLOBAL-NEXT:    ret i32 5
+; LOCAL-LABEL:  define i32 @diamond(
+; LOCAL:        join:
+; LOCAL-NEXT:     %0 = load i32, i32* %x, align 4
+; LOCAL-NEXT:     ret i32 %0
+define i32 @diamond(i1 %c) {
+entry:
+  %x = alloca i32, align 4
+  store i32 5, i32* %x, align 4
+  br i1 %c, label %then, label %join
+
+then:
+  br label %join
+
+join:
+  %0 = load i32, i32* %x, align 4
+  ret i32 %0
+}
+
+; ERROR:  cpass-server: <request>:{{[0-9]+}}:{{[0-9]+}}: error:
+; OVERSIZED:      status 1
+; OVERSIZED-NEXT: cpass-server: payload of 4611686018427387904 bytes exceeds the limit of 1073741824
+; SERVER: cpass-server: served 3 requests
@@ -0,0 +1,54 @@
+; -verbose dumps the function after each phase and the data-flow sets.
+; RUN: %cpass -verbose -disable-output < %s 2>&1 | FileCheck %s
+
+; CHECK:      post local
+; CHECK:      define void @f(i32 %x)
+; CHECK:      post DFA
+; CHECK-NEXT: copy_idx:
+; CHECK-NEXT:   0   --> i32 %x
+; CHECK-NEXT:   1   -->   store i32 %x, i32* %x.addr, align 4
+; CHECK:      BB %entry
+; CHECK-NEXT:   CPIn  0 0
+; CHECK-NEXT:   CPOut 0 1
+; CHECK-NEXT:   COPY  0 1
+; CHECK-NEXT:   KILL  0 0
+; CHECK:      post global
+define void @f(i32 %x) {
+entry:
+  %x.addr = alloca i32, align 4
+  store i32 %x, i32* %x.addr, align 4
+  ret void
+}
+
+; Copies are listed in layout order, and the set bits follow them, whatever
+; ids the analysis gave them.
+; CHECK:      post DFA
+; CHECK-NEXT: copy_idx:
+; CHECK-NEXT:   0   --> i32 %x
+; CHECK-NEXT:   1   --> i32 %y
+; CHECK-NEXT:   2   -->   store i32 %x, i32* %a, align 4
+; CHECK-NEXT:   3   -->   store i32 %y, i32* %b, align 4
+; CHECK-NEXT:   4   -->   store i32 %y, i32* %a, align 4
+; CHECK:      BB %entry
+; CHECK-NEXT:   CPIn  0 0 0 0 0
+; CHECK-NEXT:   CPOut 0 0 1 1 0
+; CHECK-NEXT:   COPY  0 0 1 1 0
+; CHECK-NEXT:   KILL  0 0 0 0 1
+; CHECK:      BB %next
+; CHECK-NEXT:   CPIn  0 0 1 1 0
+; CHECK-NEXT:   CPOut 0 0 0 1 1
+; CHECK-NEXT:   COPY  0 0 0 0 1
+; CHECK-NEXT:   KILL  0 0 1 0 0
+define i32 @g(i32 %x, i32 %y) {
+entry:
+  %a = alloca i32, align 4
+  %b = alloca i32, align 4
+  store i32 %x, i32* %a, align 4
+  store i32 %y, i32* %b, align 4
+  br label %next
+
+next:
+  store i32 %y, i32* %a, align 4
+  %r = load i32, i32* %a, align 4
+  ret i32 %r
+}